@@ -0,0 +1,37 @@
+//
+//  masks.hpp
+//  Benchmark
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef masks_hpp
+#define masks_hpp
+
+#include <string>
+#include <vector>
+
+#include "distfield.hpp"
+
+namespace Masks {
+    // width * height pixels of coverage (as Aurora rasterizes), paths are pixels >= 128
+    struct Mask {
+        std::string name;
+        int width, height;
+        std::vector<unsigned char> pixels;
+    };
+    
+    // empty, full, circles, rings (default paths of DrawPath) and scribbles
+    const std::vector<std::string>& getSyntheticNames();
+    // the same paths every time, throws if name is unknown
+    Mask makeSynthetic(const std::string& name, const int size);
+    // polylines that make the mask (empty if it has none), in pixels
+    std::vector<DistanceField::Polyline> makePolylines(const std::string& name, const int size);
+    // half width of paths in pixels, the same as Aurora when the mask is 2048x2048
+    float getHalfWidth(const int size);
+    // binary PGM (P5) with 8-bit pixels, throws if not readable
+    Mask loadPGM(const std::string& path);
+}
+
+#endif /* masks_hpp */
@@ -0,0 +1,22 @@
+//
+//  reference.hpp
+//  Benchmark
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef reference_hpp
+#define reference_hpp
+
+/*
+ 8SSEDT as written in Richard Mitton's article, which the distance field of
+ this project is modified from (http://www.codersnotes.com/notes/signed-distance-fields/).
+ it is only kept to measure the speedup claimed in README. the output is the
+ same as DistanceField::Generator::operator()(unsigned char*)
+ */
+namespace Reference {
+    void generate(unsigned char* image, const int width, const int height);
+}
+
+#endif /* reference_hpp */
@@ -0,0 +1,517 @@
+//
+//  main.cpp
+//  Benchmark
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+/*
+ Benchmarks distance field engines on synthetic masks of each size and on
+ masks dumped from real sessions (binary PGM files, see DUMP_PATHS in
+ aurora.cpp). for each mask:
+ - reference: the original 8SSEDT that README compares with (up to 4096x4096)
+ - SSEDT with each instruction set supported by the CPU, and then in parallel
+ - Exact sequentially and in parallel
+ - strips: SSEDT streamed through a scratch file with STRIP_BUDGET of memory
+ - update: signed field (as Aurora used to) after a 64x64 rectangle changes,
+   which should be the same as making the field of the new mask from scratch
+ - band: narrow band atlas from the mask
+ - segments: narrow band atlas from polylines (synthetic masks only)
+ - raster: coverage mask from polylines (synthetic masks only)
+ - JFA: jump flooding in compute shaders, only with --gpu, which creates a
+   hidden window of OpenGL 4.3 (LIBGL_ALWAYS_SOFTWARE=1 runs it on Mesa
+   llvmpipe if there is no GPU). time includes uploading and reading back.
+   it is only built with BENCHMARK_GPU (the Benchmark GPU target), so that
+   the Benchmark target needs no OpenGL, GLFW or glad
+ every run reports wall time, pixels per second and bytes moved per pass.
+ bytes are modeled from what each pass has to read and write once per pixel,
+ not measured. SSEDT should give the same result with any instruction set and
+ any number of threads, and differ from reference by at most 1 (ties are
+ broken in another order), as the exact engine and JFA do. narrow bands
+ should be the same as the whole signed field (from the mask or from
+ polylines) clamped to the same distance, and raster the same as the mask
+ made from polylines. the benchmark fails if any of them differs by more
+ than that.
+ the time saved by SSEDT against reference (what README calls speedup) is
+ measured on rings of the largest size up to 2048. with --min-saving, the
+ benchmark fails if it is lower than that. with --scaling, SSEDT and Exact
+ also run on those rings with 1, 2, 4 and 8 threads, to report how much
+ faster they are than with 1 thread (which needs as many cores)
+ Usage: Benchmark [--threads N] [--sizes 512,1024,...] [--json path]
+                  [--min-saving 0.87] [--scaling] [--gpu] [mask.pgm ...]
+ */
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef BENCHMARK_GPU
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#endif
+
+#include "distfield.hpp"
+#ifdef BENCHMARK_GPU
+#include "jumpflood.hpp"
+#endif
+#include "masks.hpp"
+#include "pathmask.hpp"
+#include "reference.hpp"
+
+using namespace std;
+using uchar = unsigned char;
+using Masks::Mask;
+
+static const int DEFAULT_SIZES[] = { 512, 1024, 2048, 4096, 8192 };
+static const int MAX_REFERENCE_SIZE = 4096;
+static const int SPEEDUP_SIZE = 2048; // same as Aurora
+static const int SCALING_THREADS[] = { 1, 2, 4, 8 };
+static const float MAX_DISTANCE = 255.0f;
+static const int DIRTY_SIZE = 64;
+static const int TILE_SIZE = 32;
+static const size_t STRIP_BUDGET = 16 << 20;
+static const char* SCRATCH_PATH = "/tmp/distfield.scratch";
+static const char* ISA_NAMES[] = { "scalar", "SSE4.1", "AVX2", "AVX-512" };
+
+static bool hasError = false; // set by checkError()
+
+struct Pass {
+    string name;
+    double milliseconds, bytes;
+};
+
+struct Run {
+    string mask, engine, isa;
+    int width, height, numThread;
+    double milliseconds, bytes; // bytes is 0 if not modeled
+    vector<Pass> passes;
+};
+
+// bytes read and written once per pixel by each pass
+static double bytesPerPixel(const string& engine, const string& pass) {
+    static const map<string, double> ssedt {
+        { "init", 1 + 4 },   // mask in, dx and dy (int16) out
+        { "sweep", 2 * 8 },  // each sweep reads and writes dx and dy
+        { "write", 4 + 1 },  // dx and dy in, byte out
+    };
+    static const map<string, double> exact {
+        { "columns", 1 + 4 + 4 + 4 }, // mask in and int out, then back up
+        { "rows", 4 + 4 },
+        { "write", 4 + 1 },
+    };
+    static const map<string, double> reference {
+        { "total", (1 + 8) + 2 * (8 + 8) + (8 + 1) }, // int dx and dy
+    };
+    static const map<string, double> none;
+    const map<string, double>& model = engine == "SSEDT" ? ssedt : engine == "Exact" ? exact :
+                                       engine == "reference" ? reference : none;
+    auto found = model.find(pass);
+    return found == model.end() ? 0.0 : found->second;
+}
+
+template <typename Func>
+static double timeIt(const Func& func) {
+    auto start = chrono::steady_clock::now();
+    func();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static Run makeRun(const Mask& mask, const string& engine, const string& isa, const int numThread,
+                   const double milliseconds, const vector<DistanceField::Generator::Pass>& passes) {
+    Run run { mask.name, engine, isa, mask.width, mask.height, numThread, milliseconds, 0.0, {} };
+    double numPixel = (double)mask.width * mask.height;
+    for (const DistanceField::Generator::Pass& pass : passes) {
+        double bytes = bytesPerPixel(engine, pass.name) * numPixel;
+        run.passes.push_back({ pass.name, pass.milliseconds, bytes });
+        run.bytes += bytes;
+    }
+    return run;
+}
+
+static Run runGenerator(const Mask& mask, const DistanceField::Engine engine,
+                        const DistanceField::Isa isa, const int numThread, vector<uchar>& output) {
+    DistanceField::Generator generator(mask.width, mask.height, numThread, engine, isa);
+    output = mask.pixels;
+    double milliseconds = timeIt([&] { generator(output.data()); });
+    bool isSSEDT = engine == DistanceField::Engine::SSEDT;
+    return makeRun(mask, isSSEDT ? "SSEDT" : "Exact", isSSEDT ? ISA_NAMES[(int)isa] : "",
+                   numThread, milliseconds, generator.getPasses());
+}
+
+static Run runReference(const Mask& mask, vector<uchar>& output) {
+    output = mask.pixels;
+    double milliseconds = timeIt([&] { Reference::generate(output.data(), mask.width, mask.height); });
+    return makeRun(mask, "reference", "", 1, milliseconds, { { "total", milliseconds } });
+}
+
+static Run runStrips(const Mask& mask, vector<uchar>& output) {
+    DistanceField::StripGenerator generator(mask.width, mask.height, STRIP_BUDGET, SCRATCH_PATH);
+    output.resize(mask.pixels.size());
+    double milliseconds = timeIt([&] {
+        generator([&] (const int y, const int numRow, uchar* rows) {
+            copy_n(mask.pixels.begin() + y * mask.width, numRow * mask.width, rows);
+        }, [&] (const int y, const int numRow, const uchar* rows) {
+            copy_n(rows, numRow * mask.width, output.begin() + y * mask.width);
+        });
+    });
+    return makeRun(mask, "strips", ISA_NAMES[(int)DistanceField::bestIsa()], 1, milliseconds, {});
+}
+
+// a rectangle at the center is shifted a little, which is then updated incrementally.
+// expected is the field of the shifted mask made from scratch
+static Run runUpdate(const Mask& mask, const int numThread, vector<DistanceField::Half>& output,
+                     vector<DistanceField::Half>& expected) {
+    DistanceField::Generator generator(mask.width, mask.height, numThread, DistanceField::Engine::Exact);
+    output.resize(mask.width * mask.height);
+    generator.update(mask.pixels.data(), { 0, 0, mask.width, mask.height }, MAX_DISTANCE, output.data());
+    
+    vector<uchar> pixels = mask.pixels;
+    int size = min(DIRTY_SIZE, min(mask.width, mask.height));
+    DistanceField::Rect dirty { (mask.width - size) / 2, (mask.height - size) / 2, size, size };
+    for (int y = dirty.y; y < dirty.y + dirty.height; ++y)
+        rotate(pixels.begin() + y * mask.width + dirty.x,
+               pixels.begin() + y * mask.width + dirty.x + 4,
+               pixels.begin() + y * mask.width + dirty.x + dirty.width);
+    
+    double milliseconds = timeIt([&] {
+        generator.update(pixels.data(), dirty, MAX_DISTANCE, output.data());
+    });
+    Run run = makeRun(mask, "update", "", numThread, milliseconds, generator.getPasses());
+    
+    expected.resize(output.size());
+    DistanceField::Generator scratch(mask.width, mask.height, numThread, DistanceField::Engine::Exact);
+    scratch.update(pixels.data(), { 0, 0, mask.width, mask.height }, MAX_DISTANCE, expected.data());
+    return run;
+}
+
+// from polylines if given, otherwise from the mask. output is the whole field
+// that the atlas stands for, which is MAX_DISTANCE out of the band
+static Run runBand(const Mask& mask, const int numThread,
+                   const vector<DistanceField::Polyline>* polylines, vector<DistanceField::Half>& output) {
+    DistanceField::NarrowBand band(mask.width, mask.height, TILE_SIZE, MAX_DISTANCE, numThread);
+    double milliseconds = timeIt([&] {
+        if (polylines) band(*polylines, Masks::getHalfWidth(mask.width));
+        else band(mask.pixels.data());
+    });
+    
+    DistanceField::Half farAway;
+    DistanceField::encode(MAX_DISTANCE, farAway);
+    output.assign(mask.pixels.size(), farAway);
+    const DistanceField::Half* atlas = band.getAtlas();
+    const int atlasWidth = band.getAtlasWidth();
+    for (int y = 0; y < mask.height; ++y) {
+        for (int x = 0; x < mask.width; ++x) {
+            const DistanceField::NarrowBand::Slot& slot =
+                band.getSlots()[(y / TILE_SIZE) * band.getNumTileX() + x / TILE_SIZE];
+            if (slot.x == DistanceField::NarrowBand::FAR_TILE) continue;
+            output[y * mask.width + x] = atlas[(slot.y * (TILE_SIZE + 2) + 1 + y % TILE_SIZE) * atlasWidth
+                                               + slot.x * (TILE_SIZE + 2) + 1 + x % TILE_SIZE];
+        }
+    }
+    return makeRun(mask, polylines ? "segments" : "band", "", numThread, milliseconds, {});
+}
+
+#ifdef BENCHMARK_GPU
+static Run runJumpFlood(const Mask& mask, vector<uchar>& output) {
+    DistanceField::JumpFlood jumpFlood(mask.width, mask.height, TILE_SIZE, MAX_DISTANCE);
+    output = mask.pixels;
+    double milliseconds = timeIt([&] { jumpFlood(output.data()); });
+    return makeRun(mask, "JFA", "GPU", 1, milliseconds, {});
+}
+#endif
+
+static float getError(const uchar output, const uchar expected) {
+    return abs(output - expected);
+}
+
+// in pixels of distance
+static float getError(const DistanceField::Half output, const DistanceField::Half expected) {
+    return fabs(DistanceField::decode(output) - DistanceField::decode(expected));
+}
+
+template <typename T>
+static void checkError(const Mask& mask, const string& engine, const vector<T>& output,
+                       const vector<T>& expected, const float tolerance) {
+    float maxError = 0.0f;
+    for (size_t i = 0; i < output.size(); ++i) maxError = max(maxError, getError(output[i], expected[i]));
+    if (maxError > tolerance) {
+        cerr << engine << " differs by " << maxError << " on " << mask.name << "!" << endl;
+        hasError = true;
+    }
+}
+
+static Run runRaster(const Mask& mask, const int numThread,
+                     const vector<DistanceField::Polyline>& polylines, vector<uchar>& output) {
+    PathMask::Rasterizer rasterizer(mask.width, mask.height, numThread);
+    output.resize(mask.pixels.size());
+    double milliseconds = timeIt([&] {
+        rasterizer(polylines, Masks::getHalfWidth(mask.width), output.data());
+    });
+    return makeRun(mask, "raster", "", numThread, milliseconds, {});
+}
+
+static vector<Run> runAll(const Mask& mask, const bool isSynthetic, const int numThread,
+                          const bool hasGPU) {
+    vector<Run> runs;
+    vector<uchar> reference, scalar, output;
+    bool hasReference = max(mask.width, mask.height) <= MAX_REFERENCE_SIZE;
+    if (hasReference) runs.push_back(runReference(mask, reference));
+    
+    // all instruction sets should give exactly the same result. reference
+    // breaks ties in another order, so it may differ by rounding
+    runs.push_back(runGenerator(mask, DistanceField::Engine::SSEDT, DistanceField::Isa::Scalar, 1, scalar));
+    if (!hasReference) reference = scalar;
+    checkError(mask, "SSEDT", scalar, reference, 1);
+    for (int isa = 1; isa <= (int)DistanceField::bestIsa(); ++isa) {
+        runs.push_back(runGenerator(mask, DistanceField::Engine::SSEDT, (DistanceField::Isa)isa, 1, output));
+        checkError(mask, string("SSEDT (") + ISA_NAMES[isa] + ")", output, scalar, 0);
+    }
+    if (numThread > 1) {
+        runs.push_back(runGenerator(mask, DistanceField::Engine::SSEDT, DistanceField::bestIsa(),
+                                    numThread, output));
+        checkError(mask, "SSEDT in parallel", output, scalar, 0);
+    }
+    runs.push_back(runStrips(mask, output));
+    checkError(mask, "SSEDT in strips", output, scalar, 0);
+    
+    runs.push_back(runGenerator(mask, DistanceField::Engine::Exact, DistanceField::Isa::Scalar, 1, output));
+    checkError(mask, "Exact", output, reference, 1);
+    if (numThread > 1) {
+        runs.push_back(runGenerator(mask, DistanceField::Engine::Exact, DistanceField::Isa::Scalar,
+                                    numThread, output));
+        checkError(mask, "Exact in parallel", output, reference, 1);
+    }
+#ifdef BENCHMARK_GPU
+    if (hasGPU) {
+        runs.push_back(runJumpFlood(mask, output));
+        checkError(mask, "JFA", output, reference, 1);
+    }
+#endif
+    
+    // updating should give exactly the same field as making it from scratch
+    vector<DistanceField::Half> field(mask.pixels.size()), band;
+    runs.push_back(runUpdate(mask, numThread, band, field));
+    checkError(mask, "update", band, field, 0);
+    
+    // narrow bands should be exactly the whole signed field clamped in the same way
+    DistanceField::Generator exact(mask.width, mask.height, numThread, DistanceField::Engine::Exact);
+    exact.update(mask.pixels.data(), { 0, 0, mask.width, mask.height }, MAX_DISTANCE, field.data());
+    runs.push_back(runBand(mask, numThread, nullptr, band));
+    checkError(mask, "band", band, field, 0);
+    if (isSynthetic) {
+        vector<DistanceField::Polyline> polylines = Masks::makePolylines(mask.name, mask.width);
+        DistanceField::SegmentField segmentField(mask.width, mask.height, MAX_DISTANCE, numThread, TILE_SIZE);
+        segmentField(polylines, Masks::getHalfWidth(mask.width), field.data());
+        runs.push_back(runBand(mask, numThread, &polylines, band));
+        checkError(mask, "segments", band, field, 0);
+        runs.push_back(runRaster(mask, numThread, polylines, output));
+        if (mask.name != "full") checkError(mask, "raster", output, mask.pixels, 0); // not from polylines
+    }
+    return runs;
+}
+
+// both CPU engines with each of SCALING_THREADS, which should give exactly what
+// they give with 1 thread
+static vector<Run> runScaling(const Mask& mask) {
+    vector<Run> runs;
+    vector<uchar> single, output;
+    for (DistanceField::Engine engine : { DistanceField::Engine::SSEDT, DistanceField::Engine::Exact }) {
+        string name = engine == DistanceField::Engine::SSEDT ? "SSEDT" : "Exact";
+        DistanceField::Isa isa = engine == DistanceField::Engine::SSEDT ? DistanceField::bestIsa()
+                                                                        : DistanceField::Isa::Scalar;
+        for (int numThread : SCALING_THREADS) {
+            runs.push_back(runGenerator(mask, engine, isa, numThread, numThread == 1 ? single : output));
+            if (numThread > 1)
+                checkError(mask, name + " with " + to_string(numThread) + " threads", output, single, 0);
+        }
+    }
+    return runs;
+}
+
+#ifdef BENCHMARK_GPU
+// hidden window that makes a context current, or null if it cannot run compute shaders
+static GLFWwindow* createContext() {
+    if (!glfwInit()) return nullptr;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(1, 1, "Benchmark", NULL, NULL);
+    if (!window) return nullptr;
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGL() || !DistanceField::JumpFlood::isSupported()) {
+        glfwDestroyWindow(window);
+        return nullptr;
+    }
+    return window;
+}
+#endif
+
+static void printHeader() {
+    cout << left << setw(12) << "mask" << right << setw(11) << "size"
+         << setw(11) << "engine" << setw(9) << "isa" << setw(4) << "x"
+         << setw(11) << "ms" << setw(10) << "Mpx/s" << setw(9) << "GB/s" << "  passes (ms)" << endl;
+}
+
+static void printRun(const Run& run) {
+    double numPixel = (double)run.width * run.height;
+    cout << left << setw(12) << run.mask << right
+         << setw(11) << to_string(run.width) + "x" + to_string(run.height)
+         << setw(11) << run.engine << setw(9) << run.isa << setw(4) << run.numThread
+         << fixed << setprecision(2) << setw(11) << run.milliseconds
+         << setw(10) << numPixel / run.milliseconds / 1e3 << setw(9);
+    if (run.bytes > 0.0) cout << run.bytes / run.milliseconds / 1e6;
+    else cout << "-";
+    cout << " ";
+    for (const Pass& pass : run.passes) cout << " " << pass.name << " " << pass.milliseconds;
+    cout << endl;
+}
+
+static string quote(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeJSON(const string& path, const vector<Run>& runs, const int numThread,
+                      const double referenceTime, const double ssedtTime) {
+    ofstream file(path);
+    if (!file) throw runtime_error("Failed to open " + path);
+    file << fixed << setprecision(4);
+    file << "{\n  \"threads\": " << numThread
+         << ",\n  \"isa\": " << quote(ISA_NAMES[(int)DistanceField::bestIsa()]);
+    if (referenceTime > 0.0) {
+        file << ",\n  \"speedup\": { \"referenceMs\": " << referenceTime << ", \"ssedtMs\": " << ssedtTime
+             << ", \"saving\": " << 1.0 - ssedtTime / referenceTime << " }";
+    }
+    file << ",\n  \"runs\": [";
+    for (size_t i = 0; i < runs.size(); ++i) {
+        const Run& run = runs[i];
+        double numPixel = (double)run.width * run.height;
+        file << (i ? ",\n" : "\n") << "    { \"mask\": " << quote(run.mask)
+             << ", \"width\": " << run.width << ", \"height\": " << run.height
+             << ", \"engine\": " << quote(run.engine) << ", \"isa\": " << quote(run.isa)
+             << ", \"threads\": " << run.numThread << ", \"ms\": " << run.milliseconds
+             << ", \"pixelsPerSecond\": " << numPixel / run.milliseconds * 1e3
+             << ", \"bytes\": " << run.bytes << ", \"passes\": [";
+        for (size_t j = 0; j < run.passes.size(); ++j) {
+            const Pass& pass = run.passes[j];
+            file << (j ? ", " : "") << "{ \"name\": " << quote(pass.name)
+                 << ", \"ms\": " << pass.milliseconds << ", \"bytes\": " << pass.bytes << " }";
+        }
+        file << "] }";
+    }
+    file << "\n  ]\n}\n";
+}
+
+int main(int argc, const char * argv[]) {
+    int numThread = (int)thread::hardware_concurrency();
+    vector<int> sizes(begin(DEFAULT_SIZES), end(DEFAULT_SIZES));
+    vector<string> files;
+    string jsonPath;
+    double minSaving = -1.0;
+    bool useGPU = false, useScaling = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue) {
+            numThread = atoi(argv[++i]);
+        } else if (arg == "--sizes" && hasValue) {
+            sizes.clear();
+            stringstream list(argv[++i]);
+            for (string size; getline(list, size, ',');) sizes.push_back(atoi(size.c_str()));
+        } else if (arg == "--json" && hasValue) {
+            jsonPath = argv[++i];
+        } else if (arg == "--min-saving" && hasValue) {
+            minSaving = atof(argv[++i]);
+        } else if (arg == "--scaling") {
+            useScaling = true;
+        } else if (arg == "--gpu") {
+            useGPU = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            cerr << "Unknown option " << arg << endl;
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    numThread = max(numThread, 1);
+    bool hasGPU = false;
+#ifdef BENCHMARK_GPU
+    hasGPU = useGPU && createContext();
+    if (useGPU && !hasGPU) cerr << "Compute shaders are not available, JFA is skipped" << endl;
+#else
+    if (useGPU) cerr << "Built without BENCHMARK_GPU, JFA is skipped" << endl;
+#endif
+    
+    cout << "threads: " << numThread << ", best instruction set: "
+         << ISA_NAMES[(int)DistanceField::bestIsa()] << endl;
+    printHeader();
+    vector<Run> runs;
+    auto addRuns = [&] (const vector<Run>& newRuns) {
+        for (const Run& run : newRuns) printRun(run);
+        runs.insert(runs.end(), newRuns.begin(), newRuns.end());
+    };
+    for (int size : sizes)
+        for (const string& name : Masks::getSyntheticNames())
+            addRuns(runAll(Masks::makeSynthetic(name, size), true, numThread, hasGPU));
+    for (const string& file : files)
+        addRuns(runAll(Masks::loadPGM(file), false, numThread, hasGPU));
+#ifdef BENCHMARK_GPU
+    if (useGPU) glfwTerminate();
+#endif
+    
+    // rings of the largest size up to SPEEDUP_SIZE, against the fastest SSEDT
+    int speedupSize = 0;
+    for (int size : sizes)
+        if (size <= SPEEDUP_SIZE) speedupSize = max(speedupSize, size);
+    double referenceTime = 0.0, ssedtTime = 0.0;
+    for (const Run& run : runs) {
+        if (run.mask != "rings" || run.width != speedupSize) continue;
+        if (run.engine == "reference") referenceTime = run.milliseconds;
+        if (run.engine == "SSEDT" && (ssedtTime == 0.0 || run.milliseconds < ssedtTime))
+            ssedtTime = run.milliseconds;
+    }
+    if (referenceTime > 0.0) {
+        cout << "SSEDT saves " << fixed << setprecision(1) << (1.0 - ssedtTime / referenceTime) * 100.0
+             << "% of time of reference on " << speedupSize << "x" << speedupSize << " rings" << endl;
+    }
+    
+    if (useScaling && speedupSize > 0) {
+        // wall time on this machine, so more threads than cores only add handoffs
+        cout << "scaling on " << speedupSize << "x" << speedupSize << " rings, "
+             << thread::hardware_concurrency() << " hardware threads:" << endl;
+        vector<Run> scaling = runScaling(Masks::makeSynthetic("rings", speedupSize));
+        addRuns(scaling);
+        for (const Run& run : scaling) {
+            if (run.numThread == 1) continue;
+            const Run& single = *find_if(scaling.begin(), scaling.end(), [&] (const Run& other) {
+                return other.engine == run.engine && other.numThread == 1;
+            });
+            cout << run.engine << " with " << run.numThread << " threads: " << fixed << setprecision(2)
+                 << single.milliseconds / run.milliseconds << "x of 1 thread" << endl;
+        }
+    }
+    
+    if (!jsonPath.empty()) writeJSON(jsonPath, runs, numThread, referenceTime, ssedtTime);
+    if (minSaving >= 0.0 && (referenceTime == 0.0 || 1.0 - ssedtTime / referenceTime < minSaving)) {
+        cerr << "Time saved is lower than " << minSaving << "!" << endl;
+        return 1;
+    }
+    return hasError ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+//
+//  masks.cpp
+//  Benchmark
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "masks.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+#include "pathmask.hpp"
+
+using namespace std;
+using DistanceField::Polyline;
+using DistanceField::Vec2;
+
+namespace Masks {
+    static const float LATITUDES[] = { 60.0f, 70.0f, 80.0f }; // default paths of DrawPath
+    static const float AURORA_RELA_HEIGHT = (6378.1f + 100.0f) / 6378.1f;
+    static const float PATH_WIDTH = 2.0f; // in pixels when the mask is 2048x2048
+    static const int NUM_CIRCLE = 16;
+    static const int NUM_SCRIBBLE = 8;
+    static const int NUM_SCRIBBLE_STEP = 256;
+    static const int NUM_RING_POINT = 1024; // each ring and circle is a closed polyline
+    
+    const vector<string>& getSyntheticNames() {
+        static const vector<string> names = { "empty", "full", "circles", "rings", "scribbles" };
+        return names;
+    }
+    
+    float getHalfWidth(const int size) {
+        return PATH_WIDTH * size / 2048.0f * 0.5f;
+    }
+    
+    static Polyline makeCircle(const float centerX, const float centerY, const float radius) {
+        Polyline polyline;
+        for (int i = 0; i <= NUM_RING_POINT; ++i) {
+            float angle = 2.0f * M_PI * i / NUM_RING_POINT;
+            polyline.push_back({ centerX + radius * cos(angle), centerY + radius * sin(angle) });
+        }
+        return polyline;
+    }
+    
+    vector<Polyline> makePolylines(const string& name, const int size) {
+        vector<Polyline> polylines;
+        mt19937 random(2018); // fixed seed, so that results are comparable across runs
+        if (name == "rings") {
+            // projected in the same way as Aurora
+            for (float lat : LATITUDES) {
+                float theta = lat / 180.0f * M_PI;
+                float ndc = cos(theta) / (sin(theta) + 1.0f / AURORA_RELA_HEIGHT);
+                polylines.push_back(makeCircle(size * 0.5f, size * 0.5f, ndc * size * 0.5f));
+            }
+        } else if (name == "circles") {
+            uniform_real_distribution<float> position(0.0f, size), radius(size / 32.0f, size / 4.0f);
+            for (int i = 0; i < NUM_CIRCLE; ++i) {
+                float x = position(random), y = position(random);
+                polylines.push_back(makeCircle(x, y, radius(random)));
+            }
+        } else if (name == "scribbles") {
+            // random walks that turn smoothly
+            uniform_real_distribution<float> position(0.0f, size), turn(-0.3f, 0.3f);
+            float step = size / 128.0f;
+            for (int i = 0; i < NUM_SCRIBBLE; ++i) {
+                Vec2 point { position(random), position(random) };
+                float heading = turn(random) * 20.0f;
+                Polyline polyline { point };
+                for (int j = 0; j < NUM_SCRIBBLE_STEP; ++j) {
+                    heading += turn(random);
+                    point.x = max(0.0f, min(point.x + step * cos(heading), (float)size));
+                    point.y = max(0.0f, min(point.y + step * sin(heading), (float)size));
+                    polyline.push_back(point);
+                }
+                polylines.push_back(polyline);
+            }
+        }
+        return polylines;
+    }
+    
+    Mask makeSynthetic(const string& name, const int size) {
+        const vector<string>& names = getSyntheticNames();
+        if (find(names.begin(), names.end(), name) == names.end())
+            throw runtime_error("Unknown mask " + name);
+        Mask mask { name, size, size, vector<unsigned char>(size * size) };
+        if (name == "full") {
+            fill(mask.pixels.begin(), mask.pixels.end(), 255);
+        } else {
+            PathMask::Rasterizer rasterizer(size, size);
+            rasterizer(makePolylines(name, size), getHalfWidth(size), mask.pixels.data());
+        }
+        return mask;
+    }
+    
+    // skips whitespaces and comments between header fields
+    static void skipComments(ifstream& file) {
+        while (file >> ws && file.peek() == '#') file.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+    
+    Mask loadPGM(const string& path) {
+        ifstream file(path, ios::binary);
+        string magic;
+        int width = 0, height = 0, maxValue = 0;
+        file >> magic;
+        skipComments(file);
+        file >> width;
+        skipComments(file);
+        file >> height;
+        skipComments(file);
+        file >> maxValue;
+        if (!file || magic != "P5" || width <= 0 || height <= 0 || maxValue != 255)
+            throw runtime_error("Failed to read PGM " + path);
+        file.get(); // single whitespace before data
+        
+        string name = path.substr(path.find_last_of('/') + 1);
+        Mask mask { name, width, height, vector<unsigned char>(width * height) };
+        file.read((char *)mask.pixels.data(), mask.pixels.size());
+        if (!file) throw runtime_error("Failed to read PGM " + path);
+        return mask;
+    }
+}
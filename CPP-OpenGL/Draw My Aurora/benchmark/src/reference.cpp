@@ -0,0 +1,112 @@
+//
+//  reference.cpp
+//  Benchmark
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "reference.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+namespace Reference {
+    struct Point {
+        int dx, dy;
+        int DistSq() const { return dx * dx + dy * dy; }
+    };
+    
+    // only the width and height are no longer fixed
+    struct Grid {
+        int width, height;
+        std::vector<Point> grid;
+    };
+    
+    static const Point inside = { 0, 0 };
+    static const Point empty = { 9999, 9999 };
+    
+    static Point Get(Grid& g, int x, int y) {
+        // OPTIMIZATION: you can skip the edge check code if you make your grid
+        // have a 1-pixel gutter.
+        if (x >= 0 && y >= 0 && x < g.width && y < g.height)
+            return g.grid[y * g.width + x];
+        else
+            return empty;
+    }
+    
+    static void Put(Grid& g, int x, int y, const Point& p) {
+        g.grid[y * g.width + x] = p;
+    }
+    
+    static void Compare(Grid& g, Point& p, int x, int y, int offsetx, int offsety) {
+        Point other = Get(g, x + offsetx, y + offsety);
+        other.dx += offsetx;
+        other.dy += offsety;
+        
+        if (other.DistSq() < p.DistSq())
+            p = other;
+    }
+    
+    static void GenerateSDF(Grid& g) {
+        // Pass 0
+        for (int y = 0; y < g.height; y++) {
+            for (int x = 0; x < g.width; x++) {
+                Point p = Get(g, x, y);
+                Compare(g, p, x, y, -1,  0);
+                Compare(g, p, x, y,  0, -1);
+                Compare(g, p, x, y, -1, -1);
+                Compare(g, p, x, y,  1, -1);
+                Put(g, x, y, p);
+            }
+            
+            for (int x = g.width - 1; x >= 0; x--) {
+                Point p = Get(g, x, y);
+                Compare(g, p, x, y, 1, 0);
+                Put(g, x, y, p);
+            }
+        }
+        
+        // Pass 1
+        for (int y = g.height - 1; y >= 0; y--) {
+            for (int x = g.width - 1; x >= 0; x--) {
+                Point p = Get(g, x, y);
+                Compare(g, p, x, y,  1,  0);
+                Compare(g, p, x, y,  0,  1);
+                Compare(g, p, x, y, -1,  1);
+                Compare(g, p, x, y,  1,  1);
+                Put(g, x, y, p);
+            }
+            
+            for (int x = 0; x < g.width; x++) {
+                Point p = Get(g, x, y);
+                Compare(g, p, x, y, -1, 0);
+                Put(g, x, y, p);
+            }
+        }
+    }
+    
+    void generate(unsigned char* image, const int width, const int height) {
+        Grid grid { width, height, std::vector<Point>(width * height) };
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                // points inside get marked with a dx/dy of zero,
+                // points outside get marked with an infinitely large distance
+                if (image[y * width + x] < 128)
+                    Put(grid, x, y, empty);
+                else
+                    Put(grid, x, y, inside);
+            }
+        }
+        
+        GenerateSDF(grid);
+        
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int dist = (int)sqrt((double)Get(grid, x, y).DistSq());
+                image[y * width + x] = 255 - (dist < 255 ? dist : 255);
+            }
+        }
+    }
+}
@@ -9,6 +9,11 @@
 #ifndef aurora_hpp
 #define aurora_hpp
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <glad/glad.h>
@@ -16,36 +21,147 @@
 
 #include "crspline.hpp"
 #include "distfield.hpp"
+#include "dynamicres.hpp"
+#include "fieldcache.hpp"
+#include "framehistory.hpp"
+#include "jumpflood.hpp"
+#include "pathmask.hpp"
+#include "radiancecache.hpp"
+#include "raymarch.hpp"
+#include "ribbons.hpp"
 #include "shader.hpp"
+#include "skytiles.hpp"
 
 class Window;
 
 class Aurora {
-    Shader pathLineShader, pathPointsShader, auroraShader;
-    DistanceField::Generator distFieldGen;
-    unsigned char* image;
-    GLuint VAO, airTrans, pathTex, fieldTex, deposition, framebuffer;
-    bool firstFrame, isRendering, shouldUpdate, shouldQuit;
+public:
+    /*
+     CPU: narrow band built by the worker, measured from curves
+     GPU: jump flooding from the path mask after it is uploaded, which needs
+     compute shaders (OpenGL 4.3). the worker then only rasterizes paths
+     */
+    enum class FieldEngine { CPU, GPU };
+    // average samples taken per pixel by rays (see countSamples())
+    struct SampleCounts {
+        double byField; // only skipping by distance fields
+        double withinSpans; // also only marched within spans of ribbons
+    };
+private:
+    /*
+     what the worker builds from paths, and is then uploaded as textures. the
+     first cascade covers the whole map, and each of the others covers half the
+     extent of the previous one around the observer, with the same pixels
+     */
+    struct Field {
+        std::vector<unsigned char> pathMask; // coverage of paths, one cascade after another
+        std::vector<DistanceField::NarrowBand> distFields; // one per cascade
+        Field();
+    };
+    Shader auroraShader;
+    PathMask::Rasterizer pathRaster; // only used by worker
+    Field field; // only used by worker
+    FieldCache fieldCache; // only used by worker
+    /*
+     worker looks up the latest paths in fieldCache, or builds them into field
+     and puts the result there. the render thread copies the ready result to a
+     pixel buffer, uploads it to the back set of textures, and swaps them with
+     the front set once uploadFence is signaled. until then, the front set
+     still holds the previous field
+     */
+    std::thread worker;
+    std::mutex fieldMutex;
+    std::condition_variable fieldCondition;
+    std::vector<DistanceField::Polyline> pendingPaths; // in map coordinates
+    glm::vec2 pendingCenter;
+    FieldEngine pendingEngine;
+    bool hasPendingPaths, shouldStopWorker;
+    std::shared_ptr<const FieldCache::Blob> readyField;
+    std::vector<DistanceField::Polyline> readyPaths; // what readyField is made from
+    // only used by the render thread
+    FieldEngine fieldEngine;
+    std::vector<DistanceField::Polyline> currentPaths;
+    glm::vec2 cascadeCenter; // of all cascades but the first, in map coordinates
+    bool hasPaths;
+    std::unique_ptr<DistanceField::JumpFlood> jumpFlood; // kept once created
+    std::unique_ptr<Shader> metricShader; // turns atlases of jumpFlood into safe steps
+    GLuint pathTex[2], fieldTex[2], tileTex[2], pyramidTex[2], pixelBuffer[2];
+    size_t pixelBufferSize[2];
+    glm::vec2 textureCenter[2]; // cascadeCenter of each set of textures
+    std::shared_ptr<const FieldCache::Blob> textureBlob[2]; // what each set is made from
+    std::vector<DistanceField::Polyline> texturePaths[2];
+    int frontTexture; // -1 before the first field lands
+    GLsync uploadFence;
+    GLuint airTrans, deposition;
+    glm::vec2 shell; // radii of the sphere below and above curtains
+    SkyTiles skyTiles;
+    Ribbons ribbons; // made from paths of the front set
+    std::unique_ptr<RadianceCache> radianceCache; // only if looking around from it
+    std::unique_ptr<FrameHistory> frameHistory; // only if frames are accumulated
+    std::unique_ptr<DynamicResolution> dynamicResolution; // only if rays may be marched for fewer pixels
+    bool firstFrame, isRendering, shouldUpdate, shouldClassify, shouldQuit;
     const float originFov, originYaw, originPitch;
     float fov, yaw, pitch, sensitivity;
     glm::vec2 lastPos;
-    void generatePath();
-    void generatePath(const std::vector<CRSpline>& splines,
-                      const GLuint prevFrameBuffer,
-                      const glm::vec4& prevViewPort);
+    void runWorker();
+    std::shared_ptr<const FieldCache::Blob> buildField(const std::vector<DistanceField::Polyline>& polylines,
+                                                       const glm::vec2& center,
+                                                       const FieldEngine engine);
+    void submitPaths();
+    // moves cascades to follow the observer, which rebuilds the field
+    void setObserver(const glm::vec3& cameraPos);
+    // false if the pixel buffer cannot be filled, in which case nothing is uploaded
+    bool uploadField(const std::shared_ptr<const FieldCache::Blob>& blob,
+                     const std::vector<DistanceField::Polyline>& paths);
+    void bindField();
+    void waitForField(const bool isCurrent = false);
+    // binds textures of aurora.fs, and looks at the north from cameraPos
+    void bindScene(const glm::vec3& cameraPos, const GLuint skybox);
+    // safe leap in render units from a point in the world, by the front field
+    float getLeap(const glm::vec3& point) const;
 public:
     Aurora(const GLuint prevFrameBuffer,
            const float fov = 45.0f,
            const float yaw = -90.0f,
            const float pitch = 0.0f,
            const float sensitivity = 0.05f);
+    // starts building a field from paths in background (replaces any pending)
+    void updatePaths(const std::vector<CRSpline>& splines);
+    // falls back to CPU if GPU is not supported, and rebuilds the field if
+    // the engine changes. returns the engine actually used
+    FieldEngine setFieldEngine(const FieldEngine engine);
+    // whether mainLoop() shows what is cached (see RadianceCache) instead of
+    // marching rays of the screen every frame
+    void setRadianceCache(const bool isEnabled);
+    // whether mainLoop() averages frames that sample more coarsely (see
+    // FrameHistory). not used if the radiance cache is
+    void setAccumulation(const bool isEnabled);
+    // whether mainLoop() marches rays for fewer pixels when they take longer
+    // than the budget (see DynamicResolution). not used if either of the above is
+    void setDynamicResolution(const bool isEnabled);
+    // uploads the field once it is built, and shows it once uploaded
+    // (should be called every frame)
+    void pollField();
+    /*
+     renders the field of paths once, looking at the north from cameraPos as
+     mainLoop() starts, into an offscreen frame of frameSize, and counts
+     samples taken by rays. blocks until the field is shown
+     */
+    SampleCounts countSamples(const glm::vec3& cameraPos, const glm::vec2& frameSize);
     void mainLoop(const Window& window,
                   const glm::vec3& cameraPos,
                   const glm::vec2& screenSize,
-                  const std::vector<CRSpline>& splines,
                   const GLuint skybox,
                   const GLuint prevFrameBuffer,
                   const glm::vec4& prevViewPort);
+    /*
+     renders a field left in the cache directory on the CPU (see RayMarch),
+     looking at the north from under its cascades, as mainLoop() starts. needs
+     no OpenGL. image: RGB of size, the bottom row first
+     */
+    static RayMarch::Stats renderStill(const std::string& fieldPath, const glm::ivec2& size,
+                                       std::vector<unsigned char>& image, const int numThread,
+                                       const DistanceField::Isa isa = DistanceField::bestIsa());
     void didScrollMouse(const double yOffset);
     void didMoveMouse(const glm::vec2& position);
     void quit();
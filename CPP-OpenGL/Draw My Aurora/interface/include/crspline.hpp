@@ -38,13 +38,15 @@ public:
              const float height = 1.0f,
              const float epsilon = 1E-2);
     void deselectControlPoint();
-    void processMouseClick(const bool isLeft,
+    // returns whether the curve has changed
+    bool processMouseClick(const bool isLeft,
                            const glm::vec3& posObject,
                            const glm::vec2& posNDC,
                            const glm::vec2& sideLengthNDC,
                            const glm::mat4& objectToNDC);
     void draw() const;
     void draw(const Shader& shader, const GLenum mode) const;
+    const std::vector<glm::vec3>& getCurvePoints() const;
 };
 
 #endif /* crspline_hpp */
@@ -29,11 +29,17 @@ class DrawPath {
     bool isDay, isEditing, shouldUpdateCamera, shouldRenderAurora;
     bool wasClicking, didClickLeft, didClickRight;
 public:
-    DrawPath();
+    DrawPath(const Aurora::FieldEngine fieldEngine = Aurora::FieldEngine::CPU,
+             const bool useRadianceCache = false, const bool useAccumulation = false,
+             const bool useDynamicResolution = false);
     void didClickMouse(const bool isLeft, const bool isPress);
     void didScrollMouse(const float yOffset);
     void didMoveMouse(const glm::vec2& position);
     void didPressButton(const int index);
+    // counts samples of aurora of the paths that the editor starts with, seen
+    // from latitude in degrees (see Aurora::countSamples()). should not be
+    // followed by mainLoop()
+    Aurora::SampleCounts countSamples(const glm::vec2& frameSize, const float latitude);
     void mainLoop();
 };
 
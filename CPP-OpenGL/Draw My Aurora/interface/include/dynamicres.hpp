@@ -0,0 +1,72 @@
+//
+//  dynamicres.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef dynamicres_hpp
+#define dynamicres_hpp
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "screenquad.hpp"
+#include "shader.hpp"
+#include "skytiles.hpp"
+
+/*
+ rays of aurora.fs are marched for fewer pixels than the screen has when they
+ take too long, and only what is in front of the skybox is then scaled up
+ and drawn over the skybox at full resolution. how long marching takes is
+ timed on the GPU (frames are paced by vsync, so the CPU cannot tell), and
+ the scale is changed by steps so that it stays within the budget
+ */
+class DynamicResolution {
+public:
+    struct Metrics {
+        float scale; // of width and height of the screen that rays are marched for
+        float passTime; // in ms, of the latest frame timed
+        float targetTime; // in ms
+        int numRaised, numLowered; // times that the scale has been changed
+    };
+private:
+    static const int NUM_QUERY = 4; // frames that may be in flight
+    Shader shader;
+    ScreenQuad quad;
+    GLuint frameBuffer, auroraTex, queries[NUM_QUERY];
+    float queryScales[NUM_QUERY]; // what each query timed at
+    int textureUnit, firstQuery, numQuery; // queries in flight
+    float minScale;
+    bool isTiming;
+    glm::vec2 frameSize, passSize;
+    GLboolean wasBlending;
+    Metrics metrics;
+    void govern(const float passTime, const float passScale);
+public:
+    /*
+     textureUnit: where the low resolution frame is bound when it is drawn.
+     skyboxUnit: where the skybox is bound by then. targetTime: in ms, for
+     marching rays of each frame
+     */
+    DynamicResolution(const int textureUnit, const int skyboxUnit, const float targetTime,
+                      const float minScale);
+    // size of the frame that rays should be marched for, which may change once
+    // timings of previous frames come back. frameSize: of the screen in pixels
+    glm::vec2 update(const glm::vec2& frameSize);
+    /*
+     binds the framebuffer that aurora.fs should draw into, whose viewport is
+     what update() returned, and starts timing. blending is disabled, since
+     aurora.fs outputs where rays go in alpha (see foregroundOnly)
+     */
+    void begin(const Shader& shader);
+    // draws the frame scaled up over the skybox of view into prevFrameBuffer at
+    // prevViewPort, and binds it. the current program is changed
+    void end(const Shader& shader, const SkyTiles::View& view, const GLuint prevFrameBuffer,
+             const glm::vec4& prevViewPort);
+    const Metrics& getMetrics() const;
+    ~DynamicResolution();
+};
+
+#endif /* dynamicres_hpp */
@@ -0,0 +1,53 @@
+//
+//  framehistory.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef framehistory_hpp
+#define framehistory_hpp
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "skytiles.hpp"
+
+/*
+ averages what rays of aurora.fs see over frames, so that each frame can
+ sample more coarsely, from offsets of blue noise that change every frame,
+ and a view that stays still still converges. when the view turns, each
+ direction is looked up where it was on the previous screen (the observer
+ never moves, so this is exact), instead of throwing the history away
+ */
+class FrameHistory {
+    GLuint frameBuffer, colorTex, historyTex[2], noiseTex;
+    int textureUnit, current, frameIndex; // historyTex[current] is drawn
+    float stepScale, maxFrames;
+    glm::vec2 frameSize;
+    glm::mat3 toPrevView;
+    GLboolean wasBlending; // into the history
+    void clear();
+public:
+    /*
+     textureUnit: where the history is bound, and blue noise at the next one.
+     stepScale: of steps of rays. maxFrames: averaged at most, so that curtains
+     that change still show up
+     */
+    FrameHistory(const int textureUnit, const float stepScale, const int maxFrames,
+                 const int noiseSize = 64);
+    // forgets what previous frames saw, which should be done when curtains change
+    void reset();
+    /*
+     binds the framebuffer that aurora.fs should draw view into, whose
+     viewport is frameSize, and sets uniforms of shader (which is then used)
+     */
+    void begin(const glm::vec2& frameSize, const SkyTiles::View& view, const Shader& shader);
+    // copies the frame to prevFrameBuffer at prevViewPort, and binds it. shader stops accumulating
+    void end(const Shader& shader, const GLuint prevFrameBuffer, const glm::vec4& prevViewPort);
+    ~FrameHistory();
+};
+
+#endif /* framehistory_hpp */
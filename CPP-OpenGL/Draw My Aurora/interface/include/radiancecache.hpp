@@ -0,0 +1,73 @@
+//
+//  radiancecache.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef radiancecache_hpp
+#define radiancecache_hpp
+
+#include <functional>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "screenquad.hpp"
+#include "shader.hpp"
+#include "skytiles.hpp"
+
+/*
+ what an observer sees in every direction, rendered into a cube map, so that
+ looking around only takes one lookup per pixel. the whole cube is rendered
+ at a low resolution at once, and then again at twice the resolution a few
+ rows per frame in the back, which is shown once done, until faces reach the
+ largest size. it stays valid as long as the observer and curtains do
+ */
+class RadianceCache {
+public:
+    /*
+     called once before rays of view are drawn into a face, which is bound as
+     frameBuffer and should be bound again if changed. frameSize: in pixels,
+     which is also the viewport
+     */
+    using PrepareFunc = std::function<void (const glm::vec2& frameSize, const SkyTiles::View& view,
+                                            const GLuint frameBuffer)>;
+    // draws rays of the prepared view over the viewport (only rows within the scissor are kept)
+    using DrawFunc = std::function<void (const SkyTiles::View& view)>;
+private:
+    Shader shader;
+    ScreenQuad quad;
+    GLuint frameBuffer, cubeMap[2]; // shows the front one
+    int textureUnit, baseSize, maxSize, pixelsPerFrame;
+    int frontSize, backSize, face, row; // where the back one is being drawn
+    bool isValid;
+    void allocate(const int index, const int size);
+    // draws rows [row, end) of the current face of the back cube map
+    void drawRows(const int end, const SkyTiles::View& view, const PrepareFunc& prepare,
+                  const DrawFunc& draw);
+public:
+    /*
+     textureUnit: where cube maps are bound when they are created or shown.
+     baseSize and maxSize: of each face in pixels, the first and the sharpest.
+     pixelsPerFrame: how many are rendered by each refine() after the first
+     */
+    RadianceCache(const int textureUnit, const int baseSize, const int maxSize, const int pixelsPerFrame);
+    // the next refine() renders the whole cube at baseSize again
+    void invalidate();
+    /*
+     renders what is seen from view.cameraPos (origin and axes do not matter)
+     a little more, and then binds prevFrameBuffer and restores prevViewPort.
+     the current program, scissor test and active texture may be changed
+     */
+    void refine(const SkyTiles::View& view, const PrepareFunc& prepare, const DrawFunc& draw,
+                const GLuint prevFrameBuffer, const glm::vec4& prevViewPort);
+    // shows the cube map as seen through the screen of view, over every pixel
+    void draw(const SkyTiles::View& view) const;
+    int getSize() const; // of faces shown, 0 if invalid
+    bool isRefined() const; // no sharper one would be rendered
+    ~RadianceCache();
+};
+
+#endif /* radiancecache_hpp */
@@ -0,0 +1,59 @@
+//
+//  ribbons.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef ribbons_hpp
+#define ribbons_hpp
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "distfield.hpp"
+#include "shader.hpp"
+#include "skytiles.hpp"
+
+/*
+ curtains extruded from paths into meshes, which are rasterized to find out
+ where each ray enters and leaves them, so that rays are only marched there.
+ a point is in a curtain if its projection onto the map (see down_to_map of
+ aurora.fs) is near a path, so each segment of a path becomes a box: a
+ rectangle around it in the map, lifted along lines through the south pole
+ to the spheres below and above curtains. walls of boxes are planes through
+ the pole, and caps are triangles lying below the higher sphere and above
+ the lower one, so boxes hold every point that may be in a curtain
+ */
+class Ribbons {
+    Shader shader;
+    GLuint VAO, VBO, frameBuffer, spanTex;
+    int numVertex;
+    glm::vec2 frameSize; // of spanTex
+public:
+    Ribbons();
+    /*
+     paths: in map coordinates. halfWidth: how far from paths curtains may
+     reach, in the map plane ([-2, 2]^2 in render units). shell: radii of the
+     spheres below and above curtains
+     */
+    void setPaths(const std::vector<DistanceField::Polyline>& paths, const float halfWidth,
+                  const glm::vec2& shell);
+    /*
+     renders spans of rays of the view into getSpans(), as rays of aurora.fs go
+     (mirrored if looking at the ground), and then binds prevFrameBuffer and
+     restores prevViewPort. frameSize: in pixels. the current program is
+     changed
+     */
+    void operator()(const glm::vec2& frameSize, const SkyTiles::View& view,
+                    const GLuint prevFrameBuffer, const glm::vec4& prevViewPort);
+    // GL_RG32F: nearest distance where rays enter curtains, and the farthest
+    // where they leave negated, both in render units (miss_t of aurora.fs if missed)
+    GLuint getSpans() const;
+    ~Ribbons();
+};
+
+#endif /* ribbons_hpp */
@@ -0,0 +1,23 @@
+//
+//  screenquad.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef screenquad_hpp
+#define screenquad_hpp
+
+#include <glad/glad.h>
+
+// two triangles covering the whole viewport, in NDC as vertex attribute 0
+class ScreenQuad {
+    GLuint VAO, VBO;
+public:
+    ScreenQuad();
+    void draw() const;
+    ~ScreenQuad();
+};
+
+#endif /* screenquad_hpp */
@@ -0,0 +1,53 @@
+//
+//  skytiles.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef skytiles_hpp
+#define skytiles_hpp
+
+#include <functional>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+/*
+ splits the screen into square tiles, and finds out on the CPU which of them
+ may show curtains, so that rays are only marched there. all rays of a tile
+ lie in a cone around its center ray (mirrored if looking at the ground, the
+ same as aurora.fs), which is marched through the aurora shell like a thick
+ ray: it is clear as long as every step is shorter than the safe leap at its
+ center minus its radius there. tiles across the horizon always need marching
+ */
+class SkyTiles {
+public:
+    enum class Kind { March, Sky }; // sky: only air and skybox
+    // how far from this point in the world (render units) curtains certainly
+    // are not, or 0 if unknown
+    using LeapFunc = std::function<float (const glm::vec3&)>;
+    // rays go from cameraPos through origin + x * xAxis + y * yAxis, where
+    // (x, y) is in NDC. shell: radii between which rays may see curtains
+    struct View {
+        glm::vec3 cameraPos, origin, xAxis, yAxis;
+        glm::vec2 shell;
+    };
+private:
+    int tileSize, numTile, numMarch;
+    GLuint VAO, VBO; // quads of tiles to march, and then the others
+    Kind classify(const View& view, const glm::vec2& ndcMin, const glm::vec2& ndcMax,
+                  const LeapFunc& leap) const;
+public:
+    SkyTiles(const int tileSize = 16);
+    // frameSize: in pixels
+    void operator()(const glm::vec2& frameSize, const View& view, const LeapFunc& leap);
+    // draws tiles of this kind as quads of NDC (vertex attribute 0)
+    void draw(const Kind kind) const;
+    int getNumTile() const;
+    int getNumSkipped() const;
+    ~SkyTiles();
+};
+
+#endif /* skytiles_hpp */
@@ -11,18 +11,41 @@
 #version 330 core
 
 in vec3 fragPos;
+in vec2 screenPos;
 
-out vec4 fragColor;
+layout (location = 0) out vec4 fragColor;
+layout (location = 1) out vec4 accumulated; // color before tone mapping, and how many frames it averages
 
 uniform vec3 cameraPos; // camera position, world coordinates
 uniform vec3 originX;
 uniform vec3 originY;
 uniform vec3 originZ;
 uniform sampler2D auroraDeposition; // deposition function
-uniform sampler2D auroraTexture; // actual curtains and color
-uniform sampler2D distanceField; // distance from curtains (0==far away, 1==close)
+uniform sampler2DArray auroraTexture; // actual curtains and color, one layer per cascade
+uniform sampler2D distanceField; // atlas of tiles near curtains, safe step in km (negative inside curtains)
+uniform isampler2DArray fieldTiles; // position of each tile in the atlas (negative if far from curtains)
+uniform sampler2DArray fieldPyramid; // safe step in km for blocks of 2^level tiles, min of the level below
+uniform int fieldPyramidLevels;
+uniform int numCascade; // each covers half the extent of the previous one, with as many pixels
+uniform vec2 cascadeCenter; // of all cascades but the first (which covers the whole map)
+uniform float fieldSize; // in pixels of each cascade
+uniform float fieldTileSize; // in pixels, without border
+uniform float auroraLowHeight; // in km, deposition is negligible below it
+uniform float auroraHighHeight; // in km, and above it
+uniform bool shouldMarch; // false where rays certainly miss curtains (see SkyTiles)
+uniform sampler2D curtainSpans; // where rays enter curtains, and where they leave negated (see Ribbons)
+uniform bool useSpans;
+uniform bool countSamples; // outputs how many samples are taken instead of color
 uniform sampler2D airTransTable;
 uniform samplerCube skybox;
+uniform bool accumulate; // blends with previous frames (see FrameHistory), otherwise the same as raymarch.cpp
+uniform float stepScale; // of dt, coarser when frames are accumulated
+uniform sampler2D blueNoise; // where rays start sampling within a step, different for each pixel
+uniform float jitterPhase; // added to offsets of blue noise, different for each frame
+uniform sampler2D history; // accumulated of the previous frame
+uniform mat3 toPrevView; // from world to (front, xAxis, yAxis) of the previous frame
+uniform float maxHistory; // frames averaged at most, so that the newest one still counts
+uniform bool foregroundOnly; // outputs what is in front of the skybox, and 0 in alpha for the ground (see DynamicResolution)
 
 const float M_PI = 3.1415926535;
 const float km = 1.0 / 6378.1; // convert kilometers to render units (planet radii)
@@ -33,6 +56,9 @@ const float auroraScale = dt / (40.0 * km); // scale factor: samples at dt -> sc
 const float airSampleStep = 0.01;
 const vec3 airColor = 0.002 * vec3(0.4, 0.5, 0.7);
 const vec3 origin = vec3(0.0, -1.0, 0.0);
+const int MAX_CASCADES = 4;
+
+int numSample = 0; // taken along this ray
 
 /* A 3D ray shooting through space */
 struct ray {
@@ -93,33 +119,64 @@ vec2 down_to_map(vec3 worldPos) {
     return samplePos;
 }
 
-/* Sample the aurora's color at this 3D point */
-vec3 sample_aurora(vec3 loc) {
+/* Find the finest cascade containing this point of the map: position in it, and its index */
+vec3 to_cascade(vec2 uv) {
+    for (int i = min(numCascade, MAX_CASCADES) - 1; i > 0; --i) {
+        vec2 pos = (uv - cascadeCenter) * exp2(float(i)) + 0.5;
+        if (all(greaterThanEqual(pos, vec2(0.0))) && all(lessThan(pos, vec2(1.0)))) return vec3(pos, float(i));
+    }
+    return vec3(uv, 0.0);
+}
+
+/* Look up how far a ray can step from this point of a cascade without skipping curtains, in km.
+ Coarse blocks are tried first, and it stops once the ray can leap over what remains */
+float field_distance(vec3 pos, float remaining) {
+    /* projections stretch without bound towards the south pole */
+    if (any(lessThan(pos.xy, vec2(0.0))) || any(greaterThanEqual(pos.xy, vec2(1.0)))) return 0.0;
+    vec2 pixel = pos.xy * fieldSize;
+    vec2 tile = floor(pixel / fieldTileSize);
+    float leap = 0.0;
+    for (int level = fieldPyramidLevels - 1; level >= 0; --level) {
+        leap = texelFetch(fieldPyramid, ivec3(ivec2(tile) >> level, pos.z), level).r;
+        if (leap >= remaining) return leap;
+    }
+    ivec2 slot = texelFetch(fieldTiles, ivec3(tile, pos.z), 0).rg;
+    if (slot.x < 0) return leap;
+    /* skip the border of this tile in the atlas */
+    vec2 atlasPos = vec2(slot) * (fieldTileSize + 2.0) + 1.0 + (pixel - tile * fieldTileSize);
+    return max(leap, texture(distanceField, atlasPos / vec2(textureSize(distanceField, 0))).r);
+}
+
+/* Sample the aurora's color at this 3D point, which is at pos of a cascade */
+vec3 sample_aurora(vec3 loc, vec3 pos) {
     /* project sample point to surface of planet, and look up in texture */
     float r = length(loc);
     vec3 deposition = deposition_function(r);
-    vec3 curtain = vec3(texture(auroraTexture, down_to_map(loc)).r);
+    vec3 curtain = vec3(texture(auroraTexture, pos).r);
     return deposition * curtain;
 }
 
-/* Sample the aurora's color along this ray, and return the summed color */
-vec3 sample_aurora(ray r, span s) {
+/* Sample the aurora's color along this ray, and return the summed color. offset: of the first sample, in steps */
+vec3 sample_aurora(ray r, span s, float offset) {
     if (s.h < 0.0) return vec3(0.0); /* whole span is behind our head */
     if (s.l < 0.0) s.l = 0.0; /* start sampling at observer's head */
     
     /* Sum up aurora light along ray span */
     vec3 sum = vec3(0.0);
     vec3 loc = ray_at(r, s.l); /* start point along ray */
-    float t = s.l;
+    float step = dt * stepScale;
+    float t = s.l + offset * step;
     while (t < s.h) {
         vec3 loc = ray_at(r, t);
-        sum += sample_aurora(loc); // real curtains
-        float dist = (0.99 - texture(distanceField, down_to_map(loc)).r) * 0.2;
-        if (dist < dt) dist = dt;
+        vec3 pos = to_cascade(down_to_map(loc));
+        sum += sample_aurora(loc, pos); // real curtains
+        ++numSample;
+        float dist = field_distance(pos, (s.h - t) / km) * km;
+        if (dist < step) dist = step;
         t += dist;
     }
     
-    return sum * auroraScale; // full curtain
+    return sum * auroraScale * stepScale; // full curtain
 }
 
 void main(void) {
@@ -141,17 +198,39 @@ void main(void) {
     ray r = ray(cameraPos, cameraDir);
     
     // All our geometry
-    span auroraL = span_sphere(sphere(vec3(0.0), 85.0 * km + 1.0), r);
-    span auroraH = span_sphere(sphere(vec3(0.0), 300.0 * km + 1.0), r);
+    span auroraL = span_sphere(sphere(vec3(0.0), auroraLowHeight * km + 1.0), r);
+    span auroraH = span_sphere(sphere(vec3(0.0), auroraHighHeight * km + 1.0), r);
     
     // Atmosphere
     float airTransmit = air_transmit(dot(cameraDir, normal));
     float airInscatter = 1.0 - airTransmit; // fraction added by atmosphere
     
     // typical planet-hitting ray
-    vec3 aurora = sample_aurora(r, span(auroraL.h, auroraH.h));
+    span s = span(auroraL.h, auroraH.h);
+    if (useSpans) {
+        vec2 curtain = texelFetch(curtainSpans, ivec2(screenPos * vec2(textureSize(curtainSpans, 0))), 0).rg;
+        s = span(max(s.l, curtain.x), min(s.h, -curtain.y));
+    }
+    float offset = 0.0;
+    if (accumulate) {
+        ivec2 noisePos = ivec2(gl_FragCoord.xy) % textureSize(blueNoise, 0);
+        offset = fract(texelFetch(blueNoise, noisePos, 0).r + jitterPhase);
+    }
+    vec3 aurora = shouldMarch ? sample_aurora(r, s, offset) : vec3(0.0);
     
     vec3 total = airTransmit * aurora + airInscatter * airColor;
+    if (accumulate) {
+        // the observer never moves, so this direction was here on the previous screen
+        vec3 prevPos = toPrevView * (fragPos - cameraPos);
+        vec2 prevScreen = prevPos.yz / prevPos.x * 0.5 + 0.5;
+        float frames = 1.0;
+        if (prevPos.x > 0.0 && all(greaterThanEqual(prevScreen, vec2(0.0))) && all(lessThanEqual(prevScreen, vec2(1.0)))) {
+            vec4 past = texture(history, prevScreen);
+            frames = min(past.a + 1.0, maxHistory);
+            total = mix(past.rgb, total, 1.0 / frames);
+        }
+        accumulated = vec4(total, frames);
+    }
 
     // Must delay tone mapping until the very end, so we can sum pre and post atmosphere parts...
     vec3 foreground = tone_map(total);
@@ -159,4 +238,6 @@ void main(void) {
     float bgStrength = 1.0 - length(foreground);
     fragColor = vec4(foreground + bgStrength * background, 1.0);
     if (isGround) fragColor *= 0.5; // assume reflectance 0.5
+    if (foregroundOnly) fragColor = vec4(foreground, isGround ? 0.0 : 1.0);
+    if (countSamples) fragColor = vec4(float(numSample), 0.0, 0.0, 1.0);
 }
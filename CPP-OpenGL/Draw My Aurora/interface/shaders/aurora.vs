@@ -3,6 +3,7 @@
 layout (location = 0) in vec2 aPos;
 
 out vec3 fragPos;
+out vec2 screenPos; // in [0, 1]
 
 uniform vec3 origin;
 uniform vec3 xAxis;
@@ -11,4 +12,5 @@ uniform vec3 yAxis;
 void main() {
     gl_Position = vec4(aPos, -1.0, 1.0);
     fragPos = origin + aPos.x * xAxis + aPos.y * yAxis;
+    screenPos = aPos * 0.5 + 0.5;
 }
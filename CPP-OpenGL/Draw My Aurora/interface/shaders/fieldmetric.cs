@@ -0,0 +1,49 @@
+#version 430 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+const float EARTH_RADIUS = 6378.1; // in km, which is the render unit
+
+uniform float fieldSize; // in pixels of each cascade
+uniform int tileSize; // without border
+uniform float safetyMargin; // in pixels
+uniform vec2 cascadeCenter; // of all cascades but the first (which covers the whole map)
+// made by JumpFlood, where tiles of each cascade are below those of the previous one
+layout (r16ui, binding = 0) uniform uimage2D atlas; // bits of half floats
+
+/* The same as encode_half() of jumpflood.cs: magnitude is rounded down */
+uint encode_half(float value) {
+    uint bits = floatBitsToUint(value);
+    uint sign = (bits >> 16) & 0x8000u;
+    int exponent = int((bits >> 23) & 0xffu) - 127 + 15;
+    uint mantissa = bits & 0x7fffffu;
+    if (exponent >= 31) return sign | 0x7bffu;
+    if (exponent <= 0) return exponent < -10 ? sign : sign | ((mantissa | 0x800000u) >> (14 - exponent));
+    return sign | (uint(exponent) << 10) | (mantissa >> 13);
+}
+
+/* The same as getSafeDistance() of aurora.cpp */
+float safe_distance(float dist, vec2 pixel, int cascade) {
+    float scale = exp2(float(cascade)) * fieldSize;
+    float planePerPixel = 4.0 / scale;
+    vec2 center = cascade == 0 ? vec2(0.5) : cascadeCenter;
+    vec2 plane = ((pixel - fieldSize * 0.5) / scale + center) * 4.0 - 2.0;
+    float rho = length(plane) + max(dist, 0.0) * planePerPixel;
+    float stretch = pow(rho * rho + 4.0, 1.5) / 8.0;
+    return (dist - safetyMargin) * planePerPixel / stretch * EARTH_RADIUS;
+}
+
+/* Turn signed distances in pixels into safe steps of ray marching in km, in place */
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(atlas)))) return;
+
+    int tileStride = tileSize + 2;
+    int cascadeHeight = (int(fieldSize) + tileSize - 1) / tileSize * tileStride;
+    int cascade = texel.y / cascadeHeight;
+    ivec2 local = ivec2(texel.x, texel.y % cascadeHeight);
+    /* the border of each tile is pixels of neighbours */
+    vec2 pixel = vec2(local / tileStride * tileSize + local % tileStride) - 0.5;
+    float dist = unpackHalf2x16(imageLoad(atlas, texel).r).x;
+    imageStore(atlas, texel, uvec4(encode_half(safe_distance(dist, pixel, cascade))));
+}
@@ -0,0 +1,101 @@
+#version 430 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+const int SEED_PASS = 0;
+const int FLOOD_PASS = 1;
+const int BYTE_PASS = 2;
+const int ATLAS_PASS = 3;
+const ivec2 NONE = ivec2(-32768); // no pixel found yet
+
+uniform int pass;
+uniform int step; // in pixels, only used by FLOOD_PASS
+uniform int tileSize; // without border, only used by ATLAS_PASS
+uniform float maxDistance;
+uniform int layer; // of mask, and of atlas (tiles of each layer are below those of the previous one)
+uniform sampler2DArray mask; // paths are texels >= 0.5
+// closest inside pixel in xy, and closest outside pixel in zw
+layout (rgba16i, binding = 0) uniform readonly iimage2D prevSeeds;
+layout (rgba16i, binding = 1) uniform writeonly iimage2D nextSeeds;
+layout (r8ui, binding = 2) uniform writeonly uimage2D bytes;
+layout (r16ui, binding = 3) uniform writeonly uimage2D atlas; // bits of half floats
+
+int dist_sq(ivec2 pixel, ivec2 seed) {
+    ivec2 offset = seed - pixel;
+    return seed == NONE ? 0x7fffffff : offset.x * offset.x + offset.y * offset.y;
+}
+
+/* Largest integer not above sqrt(value) (sqrt() on GPU may be off by a few ulps) */
+int int_sqrt(int value) {
+    int root = int(sqrt(float(value)));
+    if ((root + 1) * (root + 1) <= value) ++root;
+    if (root * root > value) --root;
+    return root;
+}
+
+/* The same as encode() of distfield.cpp: magnitude is rounded down */
+uint encode_half(float value) {
+    uint bits = floatBitsToUint(value);
+    uint sign = (bits >> 16) & 0x8000u;
+    int exponent = int((bits >> 23) & 0xffu) - 127 + 15;
+    uint mantissa = bits & 0x7fffffu;
+    if (exponent >= 31) return sign | 0x7bffu;
+    if (exponent <= 0) return exponent < -10 ? sign : sign | ((mantissa | 0x800000u) >> (14 - exponent));
+    return sign | (uint(exponent) << 10) | (mantissa >> 13);
+}
+
+/* Signed distance in pixels from the boundary (negative inside), clamped to maxDistance */
+float signed_distance(ivec2 pixel) {
+    ivec4 seeds = imageLoad(prevSeeds, pixel);
+    bool isInside = seeds.xy == pixel;
+    int distSq = dist_sq(pixel, isInside ? seeds.zw : seeds.xy);
+    float dist = distSq == 0x7fffffff ? maxDistance : min(sqrt(float(distSq)) - 0.5, maxDistance);
+    return isInside ? -dist : dist;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 fieldSize = pass == SEED_PASS ? imageSize(nextSeeds) : imageSize(prevSeeds);
+    ivec2 layerSize = (fieldSize + tileSize - 1) / tileSize * (tileSize + 2); // in atlas
+    if (any(greaterThanEqual(pixel, pass == ATLAS_PASS ? layerSize : fieldSize))) return;
+
+    if (pass == SEED_PASS) {
+        bool isInside = texelFetch(mask, ivec3(pixel, layer), 0).r >= 0.5;
+        imageStore(nextSeeds, pixel, isInside ? ivec4(pixel, NONE) : ivec4(NONE, pixel));
+    } else if (pass == FLOOD_PASS) {
+        // keep the closest ones of what this pixel and its 8 neighbours at step have found
+        ivec4 best = imageLoad(prevSeeds, pixel);
+        int bestInside = dist_sq(pixel, best.xy), bestOutside = dist_sq(pixel, best.zw);
+        for (int dy = -step; dy <= step; dy += step) {
+            for (int dx = -step; dx <= step; dx += step) {
+                ivec2 other = pixel + ivec2(dx, dy);
+                if ((dx == 0 && dy == 0) || any(lessThan(other, ivec2(0))) ||
+                    any(greaterThanEqual(other, fieldSize))) continue;
+                ivec4 seeds = imageLoad(prevSeeds, other);
+                int inside = dist_sq(pixel, seeds.xy), outside = dist_sq(pixel, seeds.zw);
+                if (inside < bestInside) {
+                    bestInside = inside;
+                    best.xy = seeds.xy;
+                }
+                if (outside < bestOutside) {
+                    bestOutside = outside;
+                    best.zw = seeds.zw;
+                }
+            }
+        }
+        imageStore(nextSeeds, pixel, best);
+    } else if (pass == BYTE_PASS) {
+        // the same as Generator::operator()(unsigned char*)
+        int distSq = dist_sq(pixel, imageLoad(prevSeeds, pixel).xy);
+        uint value = distSq < 256 * 256 ? uint(255 - int_sqrt(distSq)) : 0u;
+        imageStore(bytes, pixel, uvec4(value));
+    } else if (pass == ATLAS_PASS) {
+        // each tile has one texel of border, which is copied from neighbours
+        ivec2 tile = pixel / (tileSize + 2);
+        ivec2 source = tile * tileSize + pixel % (tileSize + 2) - 1;
+        float dist = maxDistance; // out of image
+        if (all(greaterThanEqual(source, ivec2(0))) && all(lessThan(source, fieldSize)))
+            dist = signed_distance(source);
+        imageStore(atlas, pixel + ivec2(0, layerSize.y * layer), uvec4(encode_half(dist)));
+    }
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec3 fragPos;
+
+out vec4 fragColor;
+
+uniform vec3 cameraPos;
+uniform samplerCube radiance; // what aurora.fs outputs for each direction, which is blended the same way
+
+void main() {
+    fragColor = texture(radiance, normalize(fragPos - cameraPos));
+}
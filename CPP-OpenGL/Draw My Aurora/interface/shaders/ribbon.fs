@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec3 worldPos;
+
+out vec2 span;
+
+uniform vec3 cameraPos;
+
+/* Distance along the ray, kept as is and negated, so that blending by GL_MIN keeps both ends */
+void main() {
+    float t = length(worldPos - cameraPos);
+    span = vec2(t, -t);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+out vec3 worldPos;
+
+uniform vec3 cameraPos;
+uniform vec3 normal; // of the ground at the camera
+uniform mat3 toView; // from world to (front, xAxis, yAxis) of aurora.vs
+uniform bool isMirrored; // what rays looking at the ground see (see main() of aurora.fs)
+
+void main() {
+    vec3 offset = aPos - cameraPos;
+    gl_ClipDistance[0] = dot(offset, normal); // rays only see curtains above the horizon
+    if (isMirrored) offset -= 2.0 * dot(offset, normal) * normal;
+    vec3 view = toView * offset;
+    gl_Position = vec4(view.yz, 0.0, view.x);
+    worldPos = aPos; // distances from the camera are the same when mirrored
+}
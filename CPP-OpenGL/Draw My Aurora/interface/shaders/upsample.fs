@@ -0,0 +1,45 @@
+#version 330 core
+
+in vec3 fragPos;
+in vec2 screenPos; // in [0, 1]
+
+out vec4 fragColor;
+
+uniform vec3 cameraPos;
+uniform sampler2D aurora; // foreground of aurora.fs at a lower resolution, 0 in alpha for the ground
+uniform vec2 auroraSize; // in texels that are drawn, from the corner
+uniform samplerCube skybox;
+
+void main() {
+    vec3 cameraDir = normalize(fragPos - cameraPos);
+    vec3 normal = normalize(cameraPos);
+    float elevation = dot(cameraDir, normal);
+    bool isGround = elevation <= 0.0;
+    
+    // bilinear from the four nearest texels, but those across the horizon are
+    // left out, since the ground only reflects the sky. there is no depth, and
+    // the horizon is the only edge that is known at this resolution
+    vec2 pos = screenPos * auroraSize - 0.5;
+    vec2 base = floor(pos), frac = pos - base;
+    ivec2 maxTexel = ivec2(auroraSize) - 1;
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        ivec2 corner = ivec2(i & 1, i >> 1);
+        vec4 texel = texelFetch(aurora, clamp(ivec2(base) + corner, ivec2(0), maxTexel), 0);
+        vec2 weights = mix(1.0 - frac, frac, vec2(corner));
+        float weight = weights.x * weights.y * (isGround == (texel.a < 0.5) ? 1.0 : 0.0);
+        sum += weight * texel.rgb;
+        weightSum += weight;
+    }
+    // all of them may be across when the horizon passes right here
+    vec3 foreground = weightSum > 0.0 ? sum / weightSum
+                                      : texelFetch(aurora, clamp(ivec2(pos + 0.5), ivec2(0), maxTexel), 0).rgb;
+    
+    // the same as aurora.fs, but the skybox is sampled for every pixel
+    if (isGround) cameraDir -= 2.0 * elevation * normal;
+    vec3 background = vec3(texture(skybox, cameraDir));
+    float bgStrength = 1.0 - length(foreground);
+    fragColor = vec4(foreground + bgStrength * background, 1.0);
+    if (isGround) fragColor *= 0.5;
+}
@@ -8,7 +8,15 @@
 
 #include "aurora.hpp"
 
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtc/matrix_transform.hpp>
@@ -22,11 +30,249 @@ using namespace glm;
 using uchar = unsigned char;
 
 static const int DISTANCE_FIELD_SIZE = 2048;
-static const int PATH_NUM_SAMPLE = 8;
 static const float AURORA_WIDTH = 4.0f;
+static const float FIELD_MAX_DISTANCE = 255.0f; // in pixels, also assumed outside the band
+static const float FIELD_SAFETY_MARGIN = 2.55f; // in pixels, covers filtering of paths and distances
+static const int FIELD_TILE_SIZE = 32;
+static const int FIELD_NUM_TILE = (DISTANCE_FIELD_SIZE + FIELD_TILE_SIZE - 1) / FIELD_TILE_SIZE;
+static const int FIELD_CASCADES = 3; // no more than MAX_CASCADES of aurora.fs
+static const int FIELD_PYRAMID_LEVELS = 4; // from tiles up to blocks of 8 x 8 tiles
+static const float STILL_FOV = 45.0f; // the same as the defaults of Aurora()
+static const float STILL_YAW = -90.0f;
+static const float STILL_PITCH = 0.0f;
+static const int RENDER_TILE_SIZE = 16; // in pixels, two packets of AVX2 or one of AVX-512 wide
+static const int RADIANCE_TEXTURE_UNIT = 9; // not used by aurora.fs or uploading
+static const int RADIANCE_BASE_SIZE = 128; // in pixels of each face
+static const int RADIANCE_MAX_SIZE = 2048; // finer than pixels of a 1080p screen at the default fov
+static const int RADIANCE_PIXELS_PER_FRAME = 1 << 16; // a few percent of a screen, at most
+static const int HISTORY_TEXTURE_UNIT = 10; // and blue noise at 11
+static const float HISTORY_STEP_SCALE = 2.0f; // half the samples of each frame
+static const int HISTORY_MAX_FRAMES = 16; // eight times the samples once converged
+static const int RESOLUTION_TEXTURE_UNIT = 12; // after blue noise
+static const float RESOLUTION_TARGET_TIME = 10.0f; // in ms of the GPU for rays, out of 16.7 at 60 FPS
+static const float RESOLUTION_MIN_SCALE = 0.25f; // of width and height, below which curtains blur
 static const float MIN_FOV = 10.0f;
 static const float MAX_FOV = 60.0f;
 static const float AIR_SAMPLE_STEP = 0.01f;
+static const float EARTH_RADIUS = 6378.1f; // in km, which is the render unit
+static const float DEPOSITION_MAX_HEIGHT = 300.0f; // in km, the same as deposition_function of aurora.fs
+static const float DEPOSITION_COLUMN = 0.8f; // also the same
+static const float DEPOSITION_THRESHOLD = 0.002f; // of the brightest, which leaves out less than 1% of light
+static const int UPLOAD_TEXTURE_UNIT = 6; // so that uploading never unbinds textures in use (0-5, 7 and 8)
+static const GLuint64 UPLOAD_TIMEOUT = 1000000000; // in nanoseconds
+static const size_t FIELD_CACHE_MEMORY = 128 << 20; // in bytes, about 8 fields
+static const size_t FIELD_CACHE_DISK = 256 << 20;
+static const char* FIELD_CACHE_DIRECTORY = "fields"; // empty if fields should not be saved
+static const int FIELD_FORMAT_VERSION = 5; // should be increased if fields are made differently
+// how far from paths curtains may be seen in the map plane, in render units
+// (paths are AURORA_WIDTH / 2 pixels wide in the first cascade, and are filtered)
+static const float CURTAIN_REACH = (AURORA_WIDTH / 4.0f + FIELD_SAFETY_MARGIN) * 4.0f / DISTANCE_FIELD_SIZE;
+
+/*
+ altitudes in km between which aurora deposition may be brighter than
+ DEPOSITION_THRESHOLD of its peak (in linear color), as sampled by
+ deposition_function of aurora.fs. filtering may reach one more texel on
+ each side. it is the same everywhere on the map, so rays never need to
+ sample out of this
+ */
+static vec2 getDepositionHeights(const RayMarch::Texture& deposition) {
+    int width = deposition.width, height = deposition.height;
+    int x0 = max((int)floor(DEPOSITION_COLUMN * width - 0.5f), 0), x1 = min(x0 + 1, width - 1);
+    vector<float> brightness(height);
+    for (int y = 0; y < height; ++y) {
+        for (int x : { x0, x1 }) {
+            vec4 texel = deposition.fetch(x, y);
+            brightness[y] = max(brightness[y], max(texel.r, max(texel.g, texel.b)));
+        }
+    }
+    float threshold = *max_element(brightness.begin(), brightness.end()) * DEPOSITION_THRESHOLD;
+    int low = height, high = -1;
+    for (int y = 0; y < height; ++y) {
+        if (brightness[y] >= threshold) {
+            low = min(low, y);
+            high = y;
+        }
+    }
+    if (high < 0) return vec2(0.0f);
+    return vec2(max(low - 0.5f, 0.0f), min(high + 1.5f, (float)height)) / (float)height * DEPOSITION_MAX_HEIGHT;
+}
+
+static vec2 getDepositionHeights(const GLuint deposition) {
+    GLint width, height;
+    glBindTexture(GL_TEXTURE_2D, deposition);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    vector<uchar> texels(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, texels.data()); // not decoded from sRGB
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return getDepositionHeights(RayMarch::Texture::fromBytes(texels.data(), width, height, 3, true));
+}
+
+// project a point onto the map from the south pole (the same as down_to_map of
+// aurora.fs), where the map is [0, 1) in both directions
+static vec2 projectToMap(const vec3& point) {
+    vec3 pos = point / 2.0f;
+    vec2 ndc = vec2(pos.x, pos.z) / (pos.y + 0.5f);
+    return ndc * 0.5f + 0.5f;
+}
+
+static DistanceField::Polyline projectToMap(const vector<vec3>& points) {
+    DistanceField::Polyline polyline;
+    polyline.reserve(points.size());
+    for (const vec3& point : points) {
+        vec2 uv = projectToMap(point);
+        polyline.push_back({ uv.x, uv.y });
+    }
+    return polyline;
+}
+
+// where the cascade covers in the map (the first one covers all of it)
+static vec2 getCascadeCenter(const int cascade, const vec2& center) {
+    return cascade == 0 ? vec2(0.5f) : center;
+}
+
+/*
+ ray marching needs distances in the world, while fields are measured in the
+ map plane, which is [-2, 2]^2 in render units (see down_to_map of aurora.fs).
+ moving a point above the ground by 1 moves its projection by at most
+ (rho^2 + 4)^1.5 / 8, where rho is how far the projection is from the pole
+ (1 at the pole, 2.8 at the equator). if curtains are d away in the plane,
+ every point within d / stretch(rho + d) in the world projects within d, so
+ it can be stepped over safely. returns that in km (negative inside
+ curtains), given distance in pixels of a cascade at the center of pixel
+ */
+static float getSafeDistance(const float distance, const vec2& pixel, const int cascade, const vec2& center) {
+    const float scale = exp2f(cascade) * DISTANCE_FIELD_SIZE;
+    const float planePerPixel = 4.0f / scale;
+    vec2 plane = ((pixel - DISTANCE_FIELD_SIZE * 0.5f) / scale + getCascadeCenter(cascade, center)) * 4.0f - 2.0f;
+    float rho = length(plane) + max(distance, 0.0f) * planePerPixel;
+    float stretch = pow(rho * rho + 4.0f, 1.5f) / 8.0f;
+    return (distance - FIELD_SAFETY_MARGIN) * planePerPixel / stretch * EARTH_RADIUS;
+}
+
+/*
+ lower bound of how far each tile of a cascade is from paths, in pixels. only
+ tiles with any covered pixel in the mask count as paths, and paths out of the
+ cascade may be anywhere beyond its border. unlike distance fields, this is
+ not clamped to FIELD_MAX_DISTANCE
+ */
+static vector<float> getTileDistances(const uchar* mask) {
+    vector<int> covered;
+    for (int ty = 0; ty < FIELD_NUM_TILE; ++ty) {
+        for (int tx = 0; tx < FIELD_NUM_TILE; ++tx) {
+            bool isCovered = false;
+            for (int y = ty * FIELD_TILE_SIZE; y < (ty + 1) * FIELD_TILE_SIZE && !isCovered; ++y) {
+                const uchar* row = mask + y * DISTANCE_FIELD_SIZE + tx * FIELD_TILE_SIZE;
+                for (int x = 0; x < FIELD_TILE_SIZE; ++x) isCovered |= row[x] != 0;
+            }
+            if (isCovered) covered.push_back(ty * FIELD_NUM_TILE + tx);
+        }
+    }
+    
+    vector<float> distances(FIELD_NUM_TILE * FIELD_NUM_TILE);
+    for (int ty = 0; ty < FIELD_NUM_TILE; ++ty) {
+        for (int tx = 0; tx < FIELD_NUM_TILE; ++tx) {
+            int border = min(min(tx, ty), min(FIELD_NUM_TILE - 1 - tx, FIELD_NUM_TILE - 1 - ty));
+            float distance = border * FIELD_TILE_SIZE;
+            for (int other : covered) {
+                // gaps between tiles
+                int dx = max(abs(other % FIELD_NUM_TILE - tx) - 1, 0);
+                int dy = max(abs(other / FIELD_NUM_TILE - ty) - 1, 0);
+                distance = min(distance, sqrtf(dx * dx + dy * dy) * FIELD_TILE_SIZE);
+            }
+            distances[ty * FIELD_NUM_TILE + tx] = distance;
+        }
+    }
+    return distances;
+}
+
+// where a cascade is at a level of the pyramid, in texels. each level holds all
+// cascades one after another, as layers of a mipmap
+static size_t getPyramidOffset(const int level, const int cascade) {
+    size_t offset = 0;
+    for (int i = 0; i < level; ++i)
+        offset += FIELD_CASCADES * (FIELD_NUM_TILE >> i) * (FIELD_NUM_TILE >> i);
+    return offset + cascade * (FIELD_NUM_TILE >> level) * (FIELD_NUM_TILE >> level);
+}
+
+/*
+ safe steps of ray marching in blocks of 2^level x 2^level tiles (see
+ getSafeDistance()), which hold for every point in the block, so that rays can
+ leap over empty space without looking up distance fields. the corner of a
+ block farthest from the pole takes the shortest step. each level is a min
+ pyramid of the previous one
+ */
+static void buildPyramid(const vector<float>& tileDistances, const int cascade, const vec2& center,
+                         DistanceField::Half* pyramid) {
+    vector<float> leaps(tileDistances.size());
+    for (int ty = 0; ty < FIELD_NUM_TILE; ++ty) {
+        for (int tx = 0; tx < FIELD_NUM_TILE; ++tx) {
+            float distance = tileDistances[ty * FIELD_NUM_TILE + tx], leap = numeric_limits<float>::max();
+            for (int corner = 0; corner < 4; ++corner) {
+                vec2 pixel = vec2(tx + corner % 2, ty + corner / 2) * (float)FIELD_TILE_SIZE;
+                leap = min(leap, getSafeDistance(distance, pixel, cascade, center));
+            }
+            leaps[ty * FIELD_NUM_TILE + tx] = leap;
+        }
+    }
+    
+    for (int level = 0, size = FIELD_NUM_TILE; level < FIELD_PYRAMID_LEVELS; ++level, size /= 2) {
+        if (level > 0) {
+            for (int y = 0; y < size; ++y)
+                for (int x = 0; x < size; ++x)
+                    leaps[y * size + x] = min(min(leaps[2 * y * size * 2 + 2 * x], leaps[2 * y * size * 2 + 2 * x + 1]),
+                                              min(leaps[(2 * y + 1) * size * 2 + 2 * x],
+                                                  leaps[(2 * y + 1) * size * 2 + 2 * x + 1]));
+        }
+        DistanceField::Half* texels = pyramid + getPyramidOffset(level, cascade);
+        for (int i = 0; i < size * size; ++i)
+            DistanceField::encode(leaps[i], texels[i]);
+    }
+}
+
+/*
+ paths in pixels of a cascade, which covers 1 / 2^cascade of the map in each
+ direction around center. segments that cannot affect any pixel within
+ FIELD_MAX_DISTANCE are dropped (paths are split there), since they would
+ only make the distance field and rasterizer search more
+ */
+static vector<DistanceField::Polyline> toCascade(const vector<DistanceField::Polyline>& polylines,
+                                                 const int cascade, const vec2& center,
+                                                 const float halfWidth) {
+    const float scale = exp2f(cascade) * DISTANCE_FIELD_SIZE;
+    const float margin = FIELD_MAX_DISTANCE + halfWidth + 1.0f;
+    auto toPixel = [&] (const DistanceField::Vec2& uv) -> DistanceField::Vec2 {
+        return { (uv.x - center.x) * scale + DISTANCE_FIELD_SIZE * 0.5f,
+                 (uv.y - center.y) * scale + DISTANCE_FIELD_SIZE * 0.5f };
+    };
+    auto isNear = [&] (const DistanceField::Vec2& start, const DistanceField::Vec2& end) {
+        return max(start.x, end.x) >= -margin && min(start.x, end.x) <= DISTANCE_FIELD_SIZE + margin
+            && max(start.y, end.y) >= -margin && min(start.y, end.y) <= DISTANCE_FIELD_SIZE + margin;
+    };
+    
+    vector<DistanceField::Polyline> clipped;
+    for (const DistanceField::Polyline& polyline : polylines) {
+        if (polyline.size() == 1) {
+            DistanceField::Vec2 point = toPixel(polyline[0]);
+            if (isNear(point, point)) clipped.push_back({ point });
+            continue;
+        }
+        bool isOpen = false; // whether the last segment was kept
+        for (size_t i = 1; i < polyline.size(); ++i) {
+            DistanceField::Vec2 start = toPixel(polyline[i - 1]), end = toPixel(polyline[i]);
+            if (!isNear(start, end)) {
+                isOpen = false;
+            } else if (isOpen) {
+                clipped.back().push_back(end);
+            } else {
+                clipped.push_back({ start, end });
+                isOpen = true;
+            }
+        }
+    }
+    return clipped;
+}
 
 Aurora::Aurora(const GLuint prevFrameBuffer,
                const float fov,
@@ -34,10 +280,12 @@ Aurora::Aurora(const GLuint prevFrameBuffer,
                const float pitch,
                const float sensitivity):
 originFov(fov), originYaw(yaw), originPitch(pitch), sensitivity(sensitivity),
-pathLineShader("path.vs", "path.fs", "path.gs"),
-pathPointsShader("path.vs", "path.fs"),
 auroraShader("aurora.vs", "aurora.fs"),
-distFieldGen(DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE) {
+pathRaster(DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, thread::hardware_concurrency()),
+fieldCache(FIELD_CACHE_MEMORY, FIELD_CACHE_DIRECTORY, FIELD_CACHE_DISK),
+pendingCenter(0.5f), pendingEngine(FieldEngine::CPU), hasPendingPaths(false), shouldStopWorker(false),
+fieldEngine(FieldEngine::CPU), cascadeCenter(0.5f), hasPaths(false),
+pixelBufferSize{ 0, 0 }, frontTexture(-1), uploadFence(nullptr), isRendering(false), shouldClassify(false) {
     // pre-compute air mass and store as texture lookup table
     int numSample = (int)(1.0f / AIR_SAMPLE_STEP) + 1;
     uchar *airImage = (uchar *)malloc(numSample * sizeof(uchar));
@@ -51,39 +299,39 @@ distFieldGen(DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE) {
     
     // aurora deposition is also stored as lookup table
     deposition = Loader::loadTexture("deposition.jpg", true);
+    vec2 depositionHeights = getDepositionHeights(deposition);
+    shell = depositionHeights / EARTH_RADIUS + 1.0f;
     
-    // distance field will be stored in this image
-    image = (uchar *)malloc(DISTANCE_FIELD_SIZE * DISTANCE_FIELD_SIZE * sizeof(uchar));
-    
-    glGenTextures(1, &pathTex);
-    glBindTexture(GL_TEXTURE_2D, pathTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-    Loader::set2DTexParameter(GL_CLAMP_TO_EDGE, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pathTex, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
-    
-    // vertices for ray tracer
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-    float vertices[] = {
-        -1.0f, 1.0f,  -1.0f, -1.0f,  1.0f, -1.0f,
-        -1.0f, 1.0f,   1.0f, -1.0f,  1.0f,  1.0f,
+    // front and back sets of textures made from paths, and a pixel buffer for each.
+    // paths, tiles and pyramids have one layer per cascade, while atlases of all
+    // cascades are stacked in one texture
+    glGenTextures(2, pathTex);
+    glGenTextures(2, fieldTex);
+    glGenTextures(2, tileTex);
+    glGenTextures(2, pyramidTex);
+    glGenBuffers(2, pixelBuffer);
+    auto setArrayTexParameter = [] (const GLenum interpMode) {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, interpMode);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, interpMode);
     };
-    GLuint VBO;
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    
-    pathLineShader.use();
-    pathLineShader.setFloat("lineWidth", AURORA_WIDTH / DISTANCE_FIELD_SIZE);
+    for (int i = 0; i < 2; ++i) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pathTex[i]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RED, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, FIELD_CASCADES,
+                     0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        setArrayTexParameter(GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, fieldTex[i]);
+        Loader::set2DTexParameter(GL_CLAMP_TO_EDGE, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tileTex[i]);
+        setArrayTexParameter(GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pyramidTex[i]);
+        setArrayTexParameter(GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, FIELD_PYRAMID_LEVELS - 1);
+        textureCenter[i] = vec2(0.5f);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     
     auroraShader.use();
     auroraShader.setInt("auroraDeposition", 0);
@@ -91,97 +339,579 @@ distFieldGen(DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE) {
     auroraShader.setInt("distanceField", 2);
     auroraShader.setInt("airTransTable", 3);
     auroraShader.setInt("skybox", 4);
+    auroraShader.setInt("fieldTiles", 5);
+    auroraShader.setInt("fieldPyramid", 7);
+    auroraShader.setInt("fieldPyramidLevels", FIELD_PYRAMID_LEVELS);
+    auroraShader.setFloat("fieldSize", DISTANCE_FIELD_SIZE);
+    auroraShader.setFloat("fieldTileSize", FIELD_TILE_SIZE);
+    auroraShader.setInt("numCascade", FIELD_CASCADES);
+    auroraShader.setFloat("auroraLowHeight", depositionHeights.x);
+    auroraShader.setFloat("auroraHighHeight", depositionHeights.y);
+    auroraShader.setInt("curtainSpans", 8);
+    auroraShader.setBool("shouldMarch", true);
+    auroraShader.setBool("useSpans", true);
+    auroraShader.setBool("countSamples", false);
+    auroraShader.setBool("accumulate", false);
+    auroraShader.setFloat("stepScale", 1.0f);
+    auroraShader.setInt("history", HISTORY_TEXTURE_UNIT);
+    auroraShader.setInt("blueNoise", HISTORY_TEXTURE_UNIT + 1);
+    auroraShader.setBool("foregroundOnly", false);
+    
+    worker = thread(&Aurora::runWorker, this);
 }
 
-void Aurora::generatePath(const vector<CRSpline> &splines,
-                          const GLuint prevFrameBuffer,
-                          const vec4& prevViewPort) {
-    // multisampling
-    GLuint pathMultiSample;
-    glGenTextures(1, &pathMultiSample);
-    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, pathMultiSample);
-    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, PATH_NUM_SAMPLE, GL_RED, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, GL_TRUE);
-    Loader::set2DTexParameter(GL_CLAMP_TO_EDGE, GL_LINEAR);
-    
-    GLuint framebufferMultiSample;
-    glGenFramebuffers(1, &framebufferMultiSample);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebufferMultiSample);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, pathMultiSample, 0);
-    
-    // render all paths to multisample framebuffer
-    glViewport(0, 0, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE);
-    glPointSize(AURORA_WIDTH / 2.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+Aurora::Field::Field():
+pathMask(FIELD_CASCADES * DISTANCE_FIELD_SIZE * DISTANCE_FIELD_SIZE) {
+    for (int i = 0; i < FIELD_CASCADES; ++i)
+        distFields.emplace_back(DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, FIELD_TILE_SIZE, FIELD_MAX_DISTANCE,
+                                thread::hardware_concurrency());
+}
+
+void Aurora::updatePaths(const vector<CRSpline>& splines) {
+    currentPaths.clear();
     for_each(splines.begin(), splines.end(), [&] (const CRSpline& spline) {
-        spline.draw(pathLineShader, GL_LINE_STRIP);
-        spline.draw(pathPointsShader, GL_POINTS);
+        currentPaths.push_back(projectToMap(spline.getCurvePoints()));
     });
+    hasPaths = true;
+    submitPaths();
+}
+
+Aurora::FieldEngine Aurora::setFieldEngine(const FieldEngine engine) {
+    FieldEngine newEngine = engine;
+    if (newEngine == FieldEngine::GPU && !jumpFlood) {
+        if (DistanceField::JumpFlood::isSupported()) {
+            jumpFlood.reset(new DistanceField::JumpFlood(DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE,
+                                                         FIELD_TILE_SIZE, FIELD_MAX_DISTANCE,
+                                                         FIELD_CASCADES));
+            metricShader.reset(new Shader("fieldmetric.cs"));
+            metricShader->use();
+            metricShader->setFloat("fieldSize", DISTANCE_FIELD_SIZE);
+            metricShader->setInt("tileSize", FIELD_TILE_SIZE);
+            metricShader->setFloat("safetyMargin", FIELD_SAFETY_MARGIN);
+        } else {
+            cerr << "Compute shaders are not supported, distance field stays on CPU" << endl;
+            newEngine = FieldEngine::CPU;
+        }
+    }
+    if (newEngine != fieldEngine) {
+        fieldEngine = newEngine;
+        if (hasPaths) submitPaths();
+    }
+    return fieldEngine;
+}
+
+void Aurora::setRadianceCache(const bool isEnabled) {
+    if (isEnabled && !radianceCache) {
+        GLint maxSize;
+        glGetIntegerv(GL_MAX_CUBE_MAP_TEXTURE_SIZE, &maxSize);
+        radianceCache.reset(new RadianceCache(RADIANCE_TEXTURE_UNIT, RADIANCE_BASE_SIZE,
+                                              min((int)maxSize, RADIANCE_MAX_SIZE), RADIANCE_PIXELS_PER_FRAME));
+    } else if (!isEnabled) {
+        radianceCache.reset();
+    }
+}
+
+void Aurora::setAccumulation(const bool isEnabled) {
+    if (isEnabled && !frameHistory) {
+        frameHistory.reset(new FrameHistory(HISTORY_TEXTURE_UNIT, HISTORY_STEP_SCALE, HISTORY_MAX_FRAMES));
+    } else if (!isEnabled) {
+        frameHistory.reset();
+    }
+}
+
+void Aurora::setDynamicResolution(const bool isEnabled) {
+    if (isEnabled && !dynamicResolution) {
+        dynamicResolution.reset(new DynamicResolution(RESOLUTION_TEXTURE_UNIT, 4, RESOLUTION_TARGET_TIME,
+                                                      RESOLUTION_MIN_SCALE));
+    } else if (!isEnabled) {
+        dynamicResolution.reset();
+    }
+}
+
+void Aurora::submitPaths() {
+    lock_guard<mutex> lock(fieldMutex);
+    pendingPaths = currentPaths;
+    pendingCenter = cascadeCenter;
+    pendingEngine = fieldEngine;
+    hasPendingPaths = true;
+    fieldCondition.notify_all();
+}
+
+void Aurora::setObserver(const vec3& cameraPos) {
+    // snapped to tiles of the first cascade, so that fields can be reused
+    // after moving a little
+    vec2 center = round(projectToMap(cameraPos) * (float)FIELD_NUM_TILE) / (float)FIELD_NUM_TILE;
+    if (center != cascadeCenter) {
+        cascadeCenter = center;
+        if (hasPaths) submitPaths();
+    }
+}
+
+void Aurora::runWorker() {
+    unique_lock<mutex> lock(fieldMutex);
+    while (true) {
+        fieldCondition.wait(lock, [&] { return shouldStopWorker || hasPendingPaths; });
+        if (shouldStopWorker) return;
+        
+        vector<DistanceField::Polyline> polylines = move(pendingPaths);
+        vec2 center = pendingCenter;
+        FieldEngine engine = pendingEngine;
+        hasPendingPaths = false;
+        lock.unlock();
+        shared_ptr<const FieldCache::Blob> blob = buildField(polylines, center, engine);
+        lock.lock();
+        readyField = blob; // replaces the one not uploaded yet
+        readyPaths = move(polylines);
+        fieldCondition.notify_all();
+    }
+}
+
+// what a field looks like in fieldCache, followed by masks of all cascades, the
+// pyramid, the atlas, and slots of all cascades (no atlas or slots if they are
+// left to GPU, when the size of atlas is 0)
+struct FieldHeader {
+    int32_t atlasWidth, atlasHeight;
+    float centerX, centerY; // of all cascades but the first
+};
+
+// files on disk may be left by other versions or be broken
+static bool isWholeField(const char* data, const size_t size) {
+    if (size < sizeof(FieldHeader)) return false;
+    FieldHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.atlasWidth < 0 || header.atlasHeight < 0 || (header.atlasWidth == 0) != (header.atlasHeight == 0))
+        return false;
+    size_t slotSize = header.atlasWidth > 0 ? sizeof(DistanceField::NarrowBand::Slot) : 0;
+    return size == sizeof(header) + (size_t)FIELD_CASCADES * DISTANCE_FIELD_SIZE * DISTANCE_FIELD_SIZE
+        + getPyramidOffset(FIELD_PYRAMID_LEVELS, 0) * sizeof(DistanceField::Half)
+        + (size_t)header.atlasWidth * header.atlasHeight * sizeof(DistanceField::Half)
+        + (size_t)FIELD_CASCADES * FIELD_NUM_TILE * FIELD_NUM_TILE * slotSize;
+}
+
+// the same as the first level of pyramid_leap of aurora.fs, in render units
+float Aurora::getLeap(const vec3& point) const {
+    const FieldCache::Blob& blob = *textureBlob[frontTexture];
+    const DistanceField::Half* pyramid = (const DistanceField::Half *)
+        (blob.getData() + sizeof(FieldHeader) + (size_t)FIELD_CASCADES * DISTANCE_FIELD_SIZE * DISTANCE_FIELD_SIZE);
+    vec2 uv = projectToMap(point);
+    float leap = 0.0f;
+    for (int i = 0; i < FIELD_CASCADES; ++i) {
+        vec2 pos = (uv - getCascadeCenter(i, textureCenter[frontTexture])) * exp2f(i) + 0.5f;
+        if (pos.x < 0.0f || pos.y < 0.0f || pos.x >= 1.0f || pos.y >= 1.0f) continue;
+        ivec2 tile = ivec2(pos * (float)FIELD_NUM_TILE);
+        leap = max(leap, DistanceField::decode(pyramid[getPyramidOffset(0, i) + tile.y * FIELD_NUM_TILE + tile.x]));
+    }
+    return leap / EARTH_RADIUS;
+}
+
+/*
+ the key covers everything that fields are made from: points of paths (which
+ depend on control points only), where cascades are, and settings of
+ generating them
+ */
+shared_ptr<const FieldCache::Blob> Aurora::buildField(const vector<DistanceField::Polyline>& polylines,
+                                                      const vec2& center,
+                                                      const FieldEngine engine) {
+    const float settings[] = {
+        (float)FIELD_FORMAT_VERSION, (float)DISTANCE_FIELD_SIZE, AURORA_WIDTH,
+        FIELD_MAX_DISTANCE, (float)FIELD_TILE_SIZE, (float)engine,
+        (float)FIELD_CASCADES, center.x, center.y,
+    };
+    FieldCache::Key key = FieldCache::hash(settings, sizeof(settings));
+    for (const DistanceField::Polyline& polyline : polylines) {
+        uint64_t numPoint = polyline.size();
+        key = FieldCache::hash(&numPoint, sizeof(numPoint), key);
+        key = FieldCache::hash(polyline.data(), numPoint * sizeof(DistanceField::Vec2), key);
+    }
+    shared_ptr<const FieldCache::Blob> cached = fieldCache.find(key);
+    if (cached && isWholeField(cached->getData(), cached->getSize())) return cached;
     
-    // down sampling
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferMultiSample);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
-    glBlitFramebuffer(0, 0, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE,
-                      0, 0, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE,
-                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
-    glDeleteTextures(1, &pathMultiSample);
-    glDeleteFramebuffers(1, &framebufferMultiSample);
+    // paths are rasterized on the CPU (lines are AURORA_WIDTH / 2 pixels wide in
+    // the first cascade, and as wide in the map in the others). in CPU mode,
+    // signed distance field (in pixels, negative inside curtains) is calculated
+    // directly from curves. only tiles near curtains are kept, packed into an
+    // atlas with one texel of border. distances are then turned into safe steps
+    // (see getSafeDistance())
+    const size_t maskSize = DISTANCE_FIELD_SIZE * DISTANCE_FIELD_SIZE;
+    FieldHeader header { 0, 0, center.x, center.y };
+    for (int i = 0; i < FIELD_CASCADES; ++i) {
+        float halfWidth = AURORA_WIDTH / 4.0f * exp2f(i);
+        vector<DistanceField::Polyline> pixels = toCascade(polylines, i, getCascadeCenter(i, center), halfWidth);
+        pathRaster(pixels, halfWidth, field.pathMask.data() + i * maskSize);
+        if (engine == FieldEngine::CPU) {
+            field.distFields[i](pixels, halfWidth);
+            header.atlasWidth = max(header.atlasWidth, field.distFields[i].getAtlasWidth());
+            header.atlasHeight += field.distFields[i].getAtlasHeight();
+        }
+    }
+    
+#ifdef DUMP_PATHS
+    // save paths of each cascade as binary PGM, which can be passed to Benchmark
+    static int numDump = 0;
+    for (int i = 0; i < FIELD_CASCADES; ++i) {
+        ofstream dump("paths_" + to_string(numDump) + "_" + to_string(i) + ".pgm", ios::binary);
+        dump << "P5\n" << DISTANCE_FIELD_SIZE << " " << DISTANCE_FIELD_SIZE << "\n255\n";
+        dump.write((const char *)field.pathMask.data() + i * maskSize, maskSize);
+    }
+    ++numDump;
+#endif
+    
+    size_t masksSize = field.pathMask.size();
+    size_t pyramidSize = getPyramidOffset(FIELD_PYRAMID_LEVELS, 0) * sizeof(DistanceField::Half);
+    size_t atlasSize = header.atlasWidth * header.atlasHeight * sizeof(DistanceField::Half);
+    size_t slotSize = header.atlasWidth > 0 ? FIELD_NUM_TILE * FIELD_NUM_TILE * sizeof(DistanceField::NarrowBand::Slot) : 0;
+    vector<char> data(sizeof(header) + masksSize + pyramidSize + atlasSize + FIELD_CASCADES * slotSize);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), field.pathMask.data(), masksSize);
+    
+    // tiles far away in narrow bands are known to be at least FIELD_MAX_DISTANCE
+    // from paths, even out of cascades
+    DistanceField::Half* pyramid = (DistanceField::Half *)(data.data() + sizeof(header) + masksSize);
+    for (int i = 0; i < FIELD_CASCADES; ++i) {
+        vector<float> tileDistances = getTileDistances(field.pathMask.data() + i * maskSize);
+        if (engine == FieldEngine::CPU) {
+            const vector<DistanceField::NarrowBand::Slot>& slots = field.distFields[i].getSlots();
+            for (size_t j = 0; j < slots.size(); ++j)
+                if (slots[j].x == DistanceField::NarrowBand::FAR_TILE)
+                    tileDistances[j] = max(tileDistances[j], FIELD_MAX_DISTANCE);
+        }
+        buildPyramid(tileDistances, i, center, pyramid);
+    }
+    
+    if (engine == FieldEngine::CPU) {
+        // atlases of cascades are stacked from top to bottom (the rest of narrower
+        // ones is never sampled), so slots are moved down accordingly
+        DistanceField::Half* atlas = pyramid + pyramidSize / sizeof(DistanceField::Half);
+        char* slots = (char *)atlas + atlasSize;
+        int row = 0;
+        for (int i = 0; i < FIELD_CASCADES; ++i) {
+            const DistanceField::NarrowBand& distField = field.distFields[i];
+            for (int y = 0; y < distField.getAtlasHeight(); ++y)
+                memcpy(atlas + (row + y) * header.atlasWidth, distField.getAtlas() + y * distField.getAtlasWidth(),
+                       distField.getAtlasWidth() * sizeof(DistanceField::Half));
+            vector<DistanceField::NarrowBand::Slot> moved = distField.getSlots();
+            for (int ty = 0; ty < FIELD_NUM_TILE; ++ty) {
+                for (int tx = 0; tx < FIELD_NUM_TILE; ++tx) {
+                    DistanceField::NarrowBand::Slot& slot = moved[ty * FIELD_NUM_TILE + tx];
+                    if (slot.x == DistanceField::NarrowBand::FAR_TILE) continue;
+                    slot.y += row / (FIELD_TILE_SIZE + 2);
+                    // border of tiles are pixels of neighbours
+                    for (int y = 0; y < FIELD_TILE_SIZE + 2; ++y) {
+                        DistanceField::Half* texels = atlas + (slot.y * (FIELD_TILE_SIZE + 2) + y) * header.atlasWidth
+                                                      + slot.x * (FIELD_TILE_SIZE + 2);
+                        for (int x = 0; x < FIELD_TILE_SIZE + 2; ++x) {
+                            vec2 pixel = vec2(tx * FIELD_TILE_SIZE + x, ty * FIELD_TILE_SIZE + y) - 0.5f;
+                            DistanceField::encode(getSafeDistance(DistanceField::decode(texels[x]), pixel, i, center),
+                                                  texels[x]);
+                        }
+                    }
+                }
+            }
+            memcpy(slots, moved.data(), slotSize);
+            slots += slotSize;
+            row += distField.getAtlasHeight();
+        }
+    }
+    return fieldCache.insert(key, move(data));
+}
+
+/*
+ the field is copied into a pixel buffer at once, and textures are then
+ specified from the buffer without waiting for transfers to finish. the
+ buffer is mapped with its previous content invalidated, so mapping does not
+ wait for the last upload either
+ */
+bool Aurora::uploadField(const shared_ptr<const FieldCache::Blob>& blob,
+                         const vector<DistanceField::Polyline>& paths) {
+    FieldHeader header;
+    memcpy(&header, blob->getData(), sizeof(header));
+    size_t masksSize = FIELD_CASCADES * DISTANCE_FIELD_SIZE * DISTANCE_FIELD_SIZE;
+    size_t pyramidSize = getPyramidOffset(FIELD_PYRAMID_LEVELS, 0) * sizeof(DistanceField::Half);
+    size_t atlasSize = header.atlasWidth * header.atlasHeight * sizeof(DistanceField::Half);
+    size_t dataSize = blob->getSize() - sizeof(header);
+    int back = frontTexture == 0 ? 1 : 0;
     
-    // copy data to image
-    glBindTexture(GL_TEXTURE_2D, pathTex);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, image);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer[back]);
+    if (pixelBufferSize[back] < dataSize) {
+        pixelBufferSize[back] = dataSize;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, pixelBufferSize[back], NULL, GL_STREAM_DRAW);
+    }
+    void* data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, dataSize,
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (data) memcpy(data, blob->getData() + sizeof(header), dataSize);
+    // what is written may also be lost before unmapping (e.g. the screen mode changes)
+    if (!data || !glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        cerr << "Failed to fill pixel buffer, field is uploaded later" << endl;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+    
+    // offsets into the pixel buffer
+    GLint activeUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glActiveTexture(GL_TEXTURE0 + UPLOAD_TEXTURE_UNIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pathTex[back]);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, FIELD_CASCADES,
+                    GL_RED, GL_UNSIGNED_BYTE, (void *)0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pyramidTex[back]);
+    for (int level = 0; level < FIELD_PYRAMID_LEVELS; ++level)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_R16F, FIELD_NUM_TILE >> level, FIELD_NUM_TILE >> level,
+                     FIELD_CASCADES, 0, GL_RED, GL_HALF_FLOAT,
+                     (void *)(masksSize + getPyramidOffset(level, 0) * sizeof(DistanceField::Half)));
+    if (header.atlasWidth > 0) {
+        glBindTexture(GL_TEXTURE_2D, fieldTex[back]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, header.atlasWidth, header.atlasHeight,
+                     0, GL_RED, GL_HALF_FLOAT, (void *)(masksSize + pyramidSize));
+        // where each tile is in the atlas (negative if far from curtains)
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tileTex[back]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG16I, FIELD_NUM_TILE, FIELD_NUM_TILE, FIELD_CASCADES,
+                     0, GL_RG_INTEGER, GL_SHORT, (void *)(masksSize + pyramidSize + atlasSize));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        // the whole field is the atlas, made from the masks just uploaded
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, fieldTex[back]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, jumpFlood->getAtlasWidth(), jumpFlood->getAtlasHeight(),
+                     0, GL_RED, GL_HALF_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tileTex[back]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG16I, jumpFlood->getNumTileX(), jumpFlood->getNumTileY(),
+                     FIELD_CASCADES, 0, GL_RG_INTEGER, GL_SHORT, jumpFlood->getSlots().data());
+        GLint program;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        (*jumpFlood)(pathTex[back], fieldTex[back]);
+        // distances are then turned into safe steps in place (see getSafeDistance())
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        metricShader->use();
+        metricShader->setVec2("cascadeCenter", vec2(header.centerX, header.centerY));
+        glBindImageTexture(0, fieldTex[back], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R16UI);
+        glDispatchCompute((jumpFlood->getAtlasWidth() + 7) / 8, (jumpFlood->getAtlasHeight() + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        glUseProgram(program);
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glActiveTexture(activeUnit);
+    textureCenter[back] = vec2(header.centerX, header.centerY);
+    textureBlob[back] = blob; // pyramid is also read on the CPU (see getLeap())
+    texturePaths[back] = paths;
+    uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return true;
+}
+
+void Aurora::pollField() {
+    if (uploadFence) {
+        GLenum status = glClientWaitSync(uploadFence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+        glDeleteSync(uploadFence);
+        uploadFence = nullptr;
+        frontTexture = frontTexture == 0 ? 1 : 0;
+        ribbons.setPaths(texturePaths[frontTexture], CURTAIN_REACH, shell);
+        shouldClassify = true;
+        if (radianceCache) radianceCache->invalidate();
+        if (frameHistory) frameHistory->reset();
+        if (isRendering) bindField();
+    }
+    
+    shared_ptr<const FieldCache::Blob> blob;
+    vector<DistanceField::Polyline> paths;
+    {
+        lock_guard<mutex> lock(fieldMutex);
+        blob = move(readyField);
+        readyField = nullptr;
+        paths = move(readyPaths);
+    }
+    if (blob && !uploadField(blob, paths)) {
+        // tried again next frame, unless a newer field is ready by then
+        lock_guard<mutex> lock(fieldMutex);
+        if (!readyField) {
+            readyField = move(blob);
+            readyPaths = move(paths);
+        }
+    }
+}
+
+void Aurora::bindField() {
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pathTex[frontTexture]);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, fieldTex[frontTexture]);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tileTex[frontTexture]);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pyramidTex[frontTexture]);
+    auroraShader.use();
+    auroraShader.setVec2("cascadeCenter", textureCenter[frontTexture]);
+}
+
+// only blocks if no field has ever been shown, or if isCurrent, until the one
+// made for the current cascades is
+void Aurora::waitForField(const bool isCurrent) {
+    auto isShown = [&] {
+        return frontTexture >= 0 && (!isCurrent || textureCenter[frontTexture] == cascadeCenter);
+    };
+    while (!isShown()) {
+        if (uploadFence) {
+            glClientWaitSync(uploadFence, GL_SYNC_FLUSH_COMMANDS_BIT, UPLOAD_TIMEOUT);
+        } else {
+            unique_lock<mutex> lock(fieldMutex);
+            fieldCondition.wait(lock, [&] { return readyField != nullptr; });
+        }
+        pollField();
+    }
+}
+
+// rays of tiles that cannot show curtains only go through air
+static void drawTiles(const Shader& shader, const SkyTiles& tiles) {
+    shader.setBool("shouldMarch", true);
+    tiles.draw(SkyTiles::Kind::March);
+    shader.setBool("shouldMarch", false);
+    tiles.draw(SkyTiles::Kind::Sky);
+}
+
+// average samples taken per pixel when rays march from the lower sphere to the
+// higher one and only skip by distance fields, or also only within spans of
+// ribbons. tiles are drawn into the bound framebuffer, and read back
+static double meanSamples(const Shader& shader, const SkyTiles& tiles, const vec2& frameSize,
+                          const bool useSpans) {
+    GLboolean isBlending = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    shader.setBool("countSamples", true);
+    shader.setBool("useSpans", useSpans);
+    drawTiles(shader, tiles);
+    shader.setBool("countSamples", false);
+    shader.setBool("useSpans", true);
+    if (isBlending) glEnable(GL_BLEND);
+    
+    vector<float> pixels(frameSize.x * frameSize.y);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, frameSize.x, frameSize.y, GL_RED, GL_FLOAT, pixels.data());
+    double sum = 0.0;
+    for (float count : pixels) sum += count;
+    return sum / pixels.size();
+}
+
+/*
+ where the screen is, one unit in front of the camera, looking by pitch and
+ yaw in degrees from the north. the camera is on the ground at cameraPos.
+ ratio: width over height of the screen
+ */
+static void placeScreen(const vec3& cameraPos, const float fov, const float yaw, const float pitch,
+                        const float ratio, SkyTiles::View& view) {
+    vec3 normal = normalize(cameraPos);
+    vec3 originDir = normalize(vec3(0.0f, 1.0f / normal.y, 0.0f) - cameraPos);
+    // transfrom from orignial camera space to world space
+    mat4 toWorld = inverse(lookAt(cameraPos, cameraPos + originDir, normal));
+    // front and right are in world space
+    // rotate using pitch and yaw in original camera space at first,
+    // and then convert to world space
+    vec3 front = vec3(cos(radians(pitch)) * cos(radians(yaw)),
+                      sin(radians(pitch)),
+                      cos(radians(pitch)) * sin(radians(yaw)));
+    front = vec3(toWorld * vec4(front, 0.0f));
+    vec3 right = cross(front, normal);
+    float zoom = tan(radians(fov / 2.0f));
+    view.origin = normal + front;
+    view.xAxis = right * ratio * zoom;
+    view.yAxis = cross(right, front) * zoom;
+}
+
+void Aurora::bindScene(const vec3& cameraPos, const GLuint skybox) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, deposition);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, airTrans);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox);
+    glActiveTexture(GL_TEXTURE8);
+    glBindTexture(GL_TEXTURE_2D, ribbons.getSpans());
+    bindField();
     
-    // calculate distance field
-    distFieldGen(image);
-    glGenTextures(1, &fieldTex);
-    glBindTexture(GL_TEXTURE_2D, fieldTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, image);
-    Loader::set2DTexParameter(GL_CLAMP_TO_BORDER, GL_LINEAR);
-    float borderColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    vec3 normal = normalize(cameraPos);
+    // originally look at the north
+    vec3 originDir = normalize(vec3(0.0f, 1.0f / normal.y, 0.0f) - cameraPos);
+    auroraShader.use();
+    auroraShader.setVec3("cameraPos", cameraPos);
+    auroraShader.setVec3("originX", cross(originDir, normal));
+    auroraShader.setVec3("originY", normal);
+    auroraShader.setVec3("originZ", originDir);
+}
+
+Aurora::SampleCounts Aurora::countSamples(const vec3& cameraPos, const vec2& frameSize) {
+    if (frameSize.x <= 0.0f || frameSize.y <= 0.0f) throw runtime_error("Invalid size of frame");
+    setObserver(cameraPos);
+    waitForField(true);
+    bindScene(cameraPos, 0);
+    SkyTiles::View view { cameraPos, vec3(0.0f), vec3(0.0f), vec3(0.0f), shell };
+    placeScreen(cameraPos, originFov, originYaw, originPitch, frameSize.x / frameSize.y, view);
+    auroraShader.setVec3("origin", view.origin);
+    auroraShader.setVec3("xAxis", view.xAxis);
+    auroraShader.setVec3("yAxis", view.yAxis);
+    
+    // counts are drawn offscreen as floats
+    GLint prevFrameBuffer, prevTexture;
+    GLint prevViewPort[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFrameBuffer);
+    glGetIntegerv(GL_VIEWPORT, prevViewPort);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
+    GLuint frameBuffer, counts;
+    glGenFramebuffers(1, &frameBuffer);
+    glGenTextures(1, &counts);
+    glBindTexture(GL_TEXTURE_2D, counts);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, frameSize.x, frameSize.y, 0, GL_RED, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, prevTexture);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, counts, 0);
+    glViewport(0, 0, frameSize.x, frameSize.y);
+    
+    skyTiles(frameSize, view, [&] (const vec3& point) { return getLeap(point); });
+    ribbons(frameSize, view, frameBuffer, vec4(0.0f, 0.0f, frameSize));
+    auroraShader.use();
+    SampleCounts sampleCounts;
+    sampleCounts.byField = meanSamples(auroraShader, skyTiles, frameSize, false);
+    sampleCounts.withinSpans = meanSamples(auroraShader, skyTiles, frameSize, true);
     
     glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
-    glViewport(prevViewPort.x, prevViewPort.y, prevViewPort.z, prevViewPort.w);
+    glViewport(prevViewPort[0], prevViewPort[1], prevViewPort[2], prevViewPort[3]);
+    glDeleteFramebuffers(1, &frameBuffer);
+    glDeleteTextures(1, &counts);
+    return sampleCounts;
 }
 
 void Aurora::mainLoop(const Window& window,
                       const vec3& cameraPos,
                       const vec2& screenSize,
-                      const vector<CRSpline>& splines,
                       const GLuint skybox,
                       const GLuint prevFrameBuffer,
                       const vec4& prevViewPort) {
-    generatePath(splines, prevFrameBuffer, prevViewPort);
+    setObserver(cameraPos);
+    waitForField();
+    if (radianceCache) radianceCache->invalidate();
+    if (frameHistory) frameHistory->reset();
     
     window.setCaptureCursor(true);
     glDisable(GL_DEPTH_TEST);
-    glBindVertexArray(VAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, deposition);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, pathTex);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, fieldTex);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, airTrans);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox);
+    bindScene(cameraPos, skybox);
     
     float ratio = screenSize.x / screenSize.y;
     fov = originFov;
     yaw = originYaw;
     pitch = originPitch;
-    vec3 cameraOrigin = normalize(cameraPos);
-    vec3 normal = cameraOrigin;
-    // originally look at the north
-    vec3 originDir = normalize(vec3(0.0f, 1.0f / cameraOrigin.y, 0.0f) - cameraPos);
-    // transfrom from orignial camera space to world space
-    mat4 toWorld = inverse(lookAt(cameraPos, cameraPos + originDir, normal));
-    auroraShader.use();
-    auroraShader.setVec3("cameraPos", cameraPos);
-    auroraShader.setVec3("originX", cross(originDir, normal));
-    auroraShader.setVec3("originY", normal);
-    auroraShader.setVec3("originZ", originDir);
+    SkyTiles::View view { cameraPos, vec3(0.0f), vec3(0.0f), vec3(0.0f), shell };
+    vec2 frameSize(0.0f), passSize(0.0f); // rays are marched for passSize, which may be smaller
+    SkyTiles::LeapFunc leap = [&] (const vec3& point) { return getLeap(point); };
+    // faces of the radiance cache are rendered as the screen is
+    auto prepareFace = [&] (const vec2& faceSize, const SkyTiles::View& faceView, const GLuint frameBuffer) {
+        skyTiles(faceSize, faceView, leap);
+        ribbons(faceSize, faceView, frameBuffer, vec4(0.0f, 0.0f, faceSize));
+    };
+    auto drawFace = [&] (const SkyTiles::View& faceView) {
+        auroraShader.use();
+        auroraShader.setVec3("origin", faceView.origin);
+        auroraShader.setVec3("xAxis", faceView.xAxis);
+        auroraShader.setVec3("yAxis", faceView.yAxis);
+        drawTiles(auroraShader, skyTiles);
+    };
     
     firstFrame = true;
     isRendering = true;
@@ -192,30 +922,69 @@ void Aurora::mainLoop(const Window& window,
     float lastTime = glfwGetTime();
     
     while (!shouldQuit && !window.shouldClose()) {
+        pollField();
         glClear(GL_COLOR_BUFFER_BIT);
         if (shouldUpdate) {
             shouldUpdate = false;
-            // front and right are in world space
-            // rotate using pitch and yaw in original camera space at first,
-            // and then convert to world space
-            vec3 front = vec3(cos(radians(pitch)) * cos(radians(yaw)),
-                              sin(radians(pitch)),
-                              cos(radians(pitch)) * sin(radians(yaw)));
-            front = vec3(toWorld * vec4(front, 0.0f));
-            vec3 right = cross(front, normal);
-            float zoom = tan(radians(fov / 2.0f));
-            auroraShader.setVec3("origin", cameraOrigin + front);
-            auroraShader.setVec3("xAxis", right * ratio * zoom);
-            auroraShader.setVec3("yAxis", cross(right, front) * zoom);
+            placeScreen(cameraPos, fov, yaw, pitch, ratio, view);
+            auroraShader.use();
+            auroraShader.setVec3("origin", view.origin);
+            auroraShader.setVec3("xAxis", view.xAxis);
+            auroraShader.setVec3("yAxis", view.yAxis);
+            shouldClassify = true;
+        }
+        vec4 viewPort = window.getViewPort();
+        if (vec2(viewPort.z, viewPort.w) != frameSize) {
+            frameSize = vec2(viewPort.z, viewPort.w);
+            shouldClassify = true;
+        }
+        if (radianceCache) {
+            radianceCache->refine(view, prepareFace, drawFace, prevFrameBuffer, viewPort);
+            radianceCache->draw(view);
+        } else {
+            bool isScaled = dynamicResolution && !frameHistory;
+            vec2 newPassSize = isScaled ? dynamicResolution->update(frameSize) : frameSize;
+            if (newPassSize != passSize) {
+                passSize = newPassSize;
+                shouldClassify = true;
+            }
+            if (shouldClassify) {
+                shouldClassify = false;
+                skyTiles(passSize, view, leap);
+                ribbons(passSize, view, prevFrameBuffer, viewPort);
+                auroraShader.use();
+            }
+            if (frameHistory) {
+                frameHistory->begin(frameSize, view, auroraShader);
+                drawTiles(auroraShader, skyTiles);
+                frameHistory->end(auroraShader, prevFrameBuffer, viewPort);
+            } else if (isScaled) {
+                dynamicResolution->begin(auroraShader);
+                drawTiles(auroraShader, skyTiles);
+                dynamicResolution->end(auroraShader, view, prevFrameBuffer, viewPort);
+            } else {
+                drawTiles(auroraShader, skyTiles);
+            }
         }
-        glDrawArrays(GL_TRIANGLES, 0, 6);
         window.renderFrame();
         window.processKeyboardInput();
         
         ++frameCount;
         float currentTime = glfwGetTime();
         if (currentTime - lastTime > 1.0) {
-            cout <<  "FPS: " << to_string(frameCount) << endl;
+            if (radianceCache) {
+                cout << "FPS: " << to_string(frameCount) << ", radiance cache: " << radianceCache->getSize()
+                     << " pixels" << (radianceCache->isRefined() ? "" : ", refining") << endl;
+            } else {
+                cout <<  "FPS: " << to_string(frameCount) << ", skipped tiles: "
+                     << to_string(skyTiles.getNumSkipped()) << "/" << to_string(skyTiles.getNumTile()) << endl;
+                if (dynamicResolution && !frameHistory) {
+                    const DynamicResolution::Metrics& metrics = dynamicResolution->getMetrics();
+                    cout << "resolution: " << metrics.scale << " (" << passSize.x << "x" << passSize.y
+                         << "), rays: " << metrics.passTime << "/" << metrics.targetTime << " ms, scale raised "
+                         << metrics.numRaised << " times, lowered " << metrics.numLowered << " times" << endl;
+                }
+            }
             frameCount = 0;
             lastTime = currentTime;
         }
@@ -225,8 +994,72 @@ void Aurora::mainLoop(const Window& window,
     shouldUpdate = false;
     window.setCaptureCursor(false);
     glEnable(GL_DEPTH_TEST);
-    glBindVertexArray(0);
-    glDeleteTextures(1, &fieldTex);
+}
+
+RayMarch::Stats Aurora::renderStill(const string& fieldPath, const ivec2& size, vector<uchar>& image,
+                                    const int numThread, const DistanceField::Isa isa) {
+    if (size.x <= 0 || size.y <= 0) throw runtime_error("Invalid size of still");
+    ifstream file(fieldPath, ios::binary);
+    vector<char> blob((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (!isWholeField(blob.data(), blob.size())) throw runtime_error("Not a field: " + fieldPath);
+    FieldHeader header;
+    memcpy(&header, blob.data(), sizeof(header));
+    const uchar* masks = (const uchar *)blob.data() + sizeof(header);
+    const DistanceField::Half* pyramid = (const DistanceField::Half *)
+        (masks + (size_t)FIELD_CASCADES * DISTANCE_FIELD_SIZE * DISTANCE_FIELD_SIZE);
+    const DistanceField::Half* atlas = pyramid + getPyramidOffset(FIELD_PYRAMID_LEVELS, 0);
+    const int16_t* slots = (const int16_t *)(atlas + (size_t)header.atlasWidth * header.atlasHeight);
+    
+    // the same textures as Aurora() and uploadField() make
+    RayMarch::Scene scene;
+    scene.paths = RayMarch::Texture(DISTANCE_FIELD_SIZE, DISTANCE_FIELD_SIZE, FIELD_CASCADES, 1);
+    for (size_t i = 0; i < scene.paths.texels.size(); ++i) scene.paths.texels[i] = masks[i] / 255.0f;
+    for (int level = 0; level < FIELD_PYRAMID_LEVELS; ++level) {
+        int levelSize = FIELD_NUM_TILE >> level;
+        scene.pyramid.emplace_back(levelSize, levelSize, FIELD_CASCADES, 1);
+        const DistanceField::Half* leaps = pyramid + getPyramidOffset(level, 0);
+        for (size_t i = 0; i < scene.pyramid.back().texels.size(); ++i)
+            scene.pyramid.back().texels[i] = DistanceField::decode(leaps[i]);
+    }
+    if (header.atlasWidth > 0) {
+        scene.distanceField = RayMarch::Texture(header.atlasWidth, header.atlasHeight, 1, 1);
+        for (size_t i = 0; i < scene.distanceField.texels.size(); ++i)
+            scene.distanceField.texels[i] = DistanceField::decode(atlas[i]);
+        scene.tiles.assign(slots, slots + (size_t)FIELD_CASCADES * FIELD_NUM_TILE * FIELD_NUM_TILE * 2);
+    }
+    scene.numTile = FIELD_NUM_TILE;
+    scene.cascadeCenter = vec2(header.centerX, header.centerY);
+    scene.fieldSize = DISTANCE_FIELD_SIZE;
+    scene.fieldTileSize = FIELD_TILE_SIZE;
+    
+    // deposition.jpg is loaded before DrawPath flips images, while the skybox is after
+    int width, height, channel;
+    vector<uchar> pixels = Loader::readImage("deposition.jpg", width, height, channel);
+    scene.deposition = RayMarch::Texture::fromBytes(pixels.data(), width, height, channel, true);
+    scene.deposition.isRepeated = true;
+    vec2 depositionHeights = getDepositionHeights(scene.deposition);
+    scene.auroraLowHeight = depositionHeights.x;
+    scene.auroraHighHeight = depositionHeights.y;
+    scene.setAirTrans(AIR_SAMPLE_STEP);
+    const char* boxfaces[] = {
+        "PositiveX.jpg", "NegativeX.jpg", "PositiveY.jpg", "NegativeY.jpg", "PositiveZ.jpg", "NegativeZ.jpg",
+    };
+    Loader::setFlipVertically(true);
+    for (int i = 0; i < 6; ++i) {
+        pixels = Loader::readImage(boxfaces[i], width, height, channel);
+        scene.skybox[i] = RayMarch::Texture::fromBytes(pixels.data(), width, height, channel, false);
+    }
+    Loader::setFlipVertically(false);
+    
+    // the observer is on the ground right under the center of cascades
+    vec3 line = vec3(header.centerX * 4.0f - 2.0f, 2.0f, header.centerY * 4.0f - 2.0f);
+    vec3 cameraPos = vec3(0.0f, -1.0f, 0.0f) + line * (4.0f / dot(line, line));
+    SkyTiles::View view { cameraPos, vec3(0.0f), vec3(0.0f), vec3(0.0f), vec2(0.0f) };
+    placeScreen(cameraPos, STILL_FOV, STILL_YAW, STILL_PITCH, (float)size.x / size.y, view);
+    
+    image.resize((size_t)size.x * size.y * 3);
+    RayMarch::Renderer renderer(numThread, RENDER_TILE_SIZE, isa);
+    return renderer(scene, { view.cameraPos, view.origin, view.xAxis, view.yAxis }, size.x, size.y, image.data());
 }
 
 void Aurora::didScrollMouse(const double yOffset) {
@@ -265,5 +1098,10 @@ void Aurora::quit() {
 }
 
 Aurora::~Aurora() {
-    free(image);
+    {
+        lock_guard<mutex> lock(fieldMutex);
+        shouldStopWorker = true;
+    }
+    fieldCondition.notify_all();
+    worker.join();
 }
@@ -124,7 +124,7 @@ void CRSpline::deselectControlPoint() {
     selected = CONTROL_POINT_NOT_SELECTED;
 }
 
-void CRSpline::processMouseClick(const bool isLeft,
+bool CRSpline::processMouseClick(const bool isLeft,
                                  const vec3& posObject,
                                  const vec2& posNDC,
                                  const vec2& sideLengthNDC,
@@ -177,6 +177,7 @@ void CRSpline::processMouseClick(const bool isLeft,
         return candidate;
     };
     
+    bool hasChanged = false;
     auto recalculatePoints = [&] () {
         auto updateData = [] (GLuint VBO, vector<vec3>& dataSource) {
             glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -187,6 +188,7 @@ void CRSpline::processMouseClick(const bool isLeft,
         constructSpline();
         updateData(pointVBO, controlPoints);
         updateData(curveVBO, curvePoints);
+        hasChanged = true;
     };
     
     if (isLeft) {
@@ -214,6 +216,7 @@ void CRSpline::processMouseClick(const bool isLeft,
             }
         }
     }
+    return hasChanged;
 }
 
 void CRSpline::draw() const {
@@ -235,3 +238,7 @@ void CRSpline::draw(const Shader& shader, const GLenum mode) const {
     glDrawArrays(mode, 0, curvePoints.size());
     glBindVertexArray(0);
 }
+
+const vector<vec3>& CRSpline::getCurvePoints() const {
+    return curvePoints;
+}
@@ -40,6 +40,21 @@ static const int NUM_BUTTON_TOTAL = NUM_AURORA_PATH + NUM_BUTTON_BOTTOM;
 static const int BUTTON_NOT_HIT = -1;
 static const vec3 CAMERA_POS(0.0f, 0.0f, 30.0f);
 
+// paths that the editor starts with, along a few latitudes (colors: one per path)
+static void addDefaultSplines(const Shader& pointShader, const Shader& curveShader, const vector<vec3>& colors,
+                              vector<CRSpline>& splines) {
+    vector<float> latitude = { 60.0f, 70.0f, 80.0f };
+    for (int i = 0; i < NUM_AURORA_PATH; ++i) {
+        vector<vec3> controlPoints;
+        float lat = radians(latitude[i]);
+        float sinLat = sin(lat), cosLat = cos(lat);
+        for (float angle = 0.0f; angle < 360.0f; angle += 45.0f)
+            controlPoints.push_back(vec3(cos(radians(angle)) * cosLat, sinLat, sin(radians(angle)) * cosLat));
+        
+        splines.push_back(CRSpline(pointShader, curveShader, colors[i], controlPoints, AURORA_RELA_HEIGHT));
+    }
+}
+
 void DrawPath::didClickMouse(const bool isLeft, const bool isPress) {
     if (shouldRenderAurora) {
         if (!isLeft && isPress) {
@@ -95,10 +110,24 @@ void DrawPath::didPressButton(const int index) {
     }
 }
 
-DrawPath::DrawPath():
+DrawPath::DrawPath(const Aurora::FieldEngine fieldEngine, const bool useRadianceCache,
+                   const bool useAccumulation, const bool useDynamicResolution):
 window(this), camera(CAMERA_POS), aurora(0) {
     Loader::setFlipVertically(true);
     camera.setScreenSize(window.getOriginalSize());
+    aurora.setFieldEngine(fieldEngine);
+    aurora.setRadianceCache(useRadianceCache);
+    aurora.setAccumulation(useAccumulation);
+    aurora.setDynamicResolution(useDynamicResolution);
+}
+
+Aurora::SampleCounts DrawPath::countSamples(const vec2& frameSize, const float latitude) {
+    Shader pointShader("spline.vs", "spline.fs", "spline.gs");
+    Shader curveShader("spline.vs", "spline.fs");
+    addDefaultSplines(pointShader, curveShader, vector<vec3>(NUM_AURORA_PATH, vec3(1.0f)), splines);
+    aurora.updatePaths(splines);
+    float lat = radians(latitude);
+    return aurora.countSamples(vec3(cos(lat), sin(lat), 0.0f), frameSize);
 }
 
 void DrawPath::mainLoop() {
@@ -213,18 +242,13 @@ void DrawPath::mainLoop() {
     
     Shader curveShader("spline.vs", "spline.fs");
     
-    vector<float> latitude = { 60.0f, 70.0f, 80.0f };
-    for (int i = 0; i < NUM_AURORA_PATH; ++i) {
-        vector<vec3> controlPoints;
-        float lat = radians(latitude[i]);
-        float sinLat = sin(lat), cosLat = cos(lat);
-        for (float angle = 0.0f; angle < 360.0f; angle += 45.0f)
-            controlPoints.push_back(vec3(cos(radians(angle)) * cosLat, sinLat, sin(radians(angle)) * cosLat));
-        
-        splines.push_back(CRSpline(pointShader, curveShader,
-                                   buttonColor[(i + NUM_BUTTON_BOTTOM) * 2],
-                                   controlPoints, AURORA_RELA_HEIGHT));
-    }
+    vector<vec3> pathColor;
+    for (int i = 0; i < NUM_AURORA_PATH; ++i)
+        pathColor.push_back(buttonColor[(i + NUM_BUTTON_BOTTOM) * 2]);
+    addDefaultSplines(pointShader, curveShader, pathColor, splines);
+    
+    // the field is built in background, so that it is ready when aurora is rendered
+    aurora.updatePaths(splines);
     
     // the first path is chosen by default
     editingPath = 0;
@@ -366,7 +390,7 @@ void DrawPath::mainLoop() {
             // shouldRenderAurora remains true until exit
             vec3 position, normal;
             getIntersection(vec3(0.0f), position, normal);
-            aurora.mainLoop(window, position, window.getOriginalSize(), splines,
+            aurora.mainLoop(window, position, window.getOriginalSize(),
                             universeTex, 0, window.getViewPort());
             shouldRenderAurora = false;
         }
@@ -387,8 +411,9 @@ void DrawPath::mainLoop() {
                 if (buttonHitTest() == BUTTON_NOT_HIT) {
                     vec3 position, normal;
                     if (getIntersection(window.getClickNDC(), position, normal, AURORA_RELA_HEIGHT)) {
-                        splines[editingPath].processMouseClick(false, position, window.getClickNDC(),
-                                                               sideLengthNDC, inverse(ndcToEarth));
+                        if (splines[editingPath].processMouseClick(false, position, window.getClickNDC(),
+                                                                   sideLengthNDC, inverse(ndcToEarth)))
+                            aurora.updatePaths(splines);
                         mayOnSpline = true;
                     }
                 }
@@ -404,8 +429,9 @@ void DrawPath::mainLoop() {
                 vec3 position, normal;
                 if (isEditing) {
                     if (getIntersection(window.getClickNDC(), position, normal, AURORA_RELA_HEIGHT)) {
-                        splines[editingPath].processMouseClick(true, position, window.getClickNDC(),
-                                                               sideLengthNDC, inverse(ndcToEarth));
+                        if (splines[editingPath].processMouseClick(true, position, window.getClickNDC(),
+                                                                   sideLengthNDC, inverse(ndcToEarth)))
+                            aurora.updatePaths(splines);
                         // do not simply assign true to stillClicking!
                         // left mouse key may have already been released
                         stillClicking = wasClicking;
@@ -432,6 +458,7 @@ void DrawPath::mainLoop() {
         else shouldScroll = false; // stop inertial scrolling
         
         renderScene();
+        aurora.pollField();
         window.renderFrame();
         window.processKeyboardInput();
         
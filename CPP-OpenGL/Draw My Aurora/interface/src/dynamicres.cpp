@@ -0,0 +1,134 @@
+//
+//  dynamicres.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "dynamicres.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+static const float SCALE_STEP = 1.0f / 16.0f; // so that spans of ribbons are not made again every frame
+static const float MIN_PASS_TIME = 0.01f; // in ms, below which timings say nothing
+
+DynamicResolution::DynamicResolution(const int textureUnit, const int skyboxUnit, const float targetTime,
+                                     const float minScale):
+shader("aurora.vs", "upsample.fs"), textureUnit(textureUnit), firstQuery(0), numQuery(0),
+minScale(clamp(round(minScale / SCALE_STEP) * SCALE_STEP, SCALE_STEP, 1.0f)), isTiming(false),
+frameSize(0.0f), passSize(0.0f), wasBlending(GL_FALSE), metrics{ 1.0f, 0.0f, targetTime, 0, 0 } {
+    glGenFramebuffers(1, &frameBuffer);
+    glGenTextures(1, &auroraTex);
+    glGenQueries(NUM_QUERY, queries);
+    
+    shader.use();
+    shader.setInt("aurora", textureUnit);
+    shader.setInt("skybox", skyboxUnit);
+}
+
+void DynamicResolution::govern(const float passTime, const float passScale) {
+    metrics.passTime = passTime;
+    // time grows with pixels, and so with the square of the scale. it is lowered
+    // by whole steps at once until within the budget, since frames are dropped
+    // until then, but raised only by whole steps within half way, so that it does
+    // not go back and forth. frames still in flight were timed at the old scale,
+    // but say the same
+    float ideal = passScale * sqrt(metrics.targetTime / max(passTime, MIN_PASS_TIME));
+    float change = clamp(ideal, minScale, 1.0f) - metrics.scale;
+    int numStep = change < 0.0f ? (int)floor(change / SCALE_STEP) : (int)(change * 0.5f / SCALE_STEP);
+    if (numStep == 0) return;
+    metrics.scale = clamp(metrics.scale + numStep * SCALE_STEP, minScale, 1.0f);
+    if (numStep > 0) ++metrics.numRaised;
+    else ++metrics.numLowered;
+}
+
+vec2 DynamicResolution::update(const vec2& frameSize) {
+    // timings come back a few frames late, the oldest first
+    while (numQuery > 0) {
+        GLint isAvailable;
+        glGetQueryObjectiv(queries[firstQuery], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (!isAvailable) break;
+        GLuint64 elapsed; // in ns
+        glGetQueryObjectui64v(queries[firstQuery], GL_QUERY_RESULT, &elapsed);
+        govern(elapsed / 1e6f, queryScales[firstQuery]);
+        firstQuery = (firstQuery + 1) % NUM_QUERY;
+        --numQuery;
+    }
+    
+    // the texture is as large as the screen, and only the corner of passSize is drawn
+    if (frameSize != this->frameSize) {
+        this->frameSize = frameSize;
+        GLint activeUnit, prevFrameBuffer;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFrameBuffer);
+        glActiveTexture(GL_TEXTURE0 + textureUnit);
+        glBindTexture(GL_TEXTURE_2D, auroraTex);
+        // foreground may be brighter than 1, which takes away from the skybox
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, frameSize.x, frameSize.y, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glActiveTexture(activeUnit);
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, auroraTex, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
+    }
+    passSize = max(round(frameSize * metrics.scale), vec2(1.0f));
+    return passSize;
+}
+
+void DynamicResolution::begin(const Shader& shader) {
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glViewport(0, 0, passSize.x, passSize.y);
+    wasBlending = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    shader.use();
+    shader.setBool("foregroundOnly", true);
+    
+    // not timed if all queries are still in flight
+    isTiming = numQuery < NUM_QUERY;
+    if (isTiming) {
+        int index = (firstQuery + numQuery) % NUM_QUERY;
+        queryScales[index] = metrics.scale;
+        glBeginQuery(GL_TIME_ELAPSED, queries[index]);
+    }
+}
+
+void DynamicResolution::end(const Shader& shader, const SkyTiles::View& view, const GLuint prevFrameBuffer,
+                            const vec4& prevViewPort) {
+    if (isTiming) {
+        glEndQuery(GL_TIME_ELAPSED);
+        ++numQuery;
+    }
+    shader.setBool("foregroundOnly", false);
+    if (wasBlending) glEnable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
+    glViewport(prevViewPort.x, prevViewPort.y, prevViewPort.z, prevViewPort.w);
+    
+    GLint activeUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, auroraTex);
+    glActiveTexture(activeUnit);
+    this->shader.use();
+    this->shader.setVec3("cameraPos", view.cameraPos);
+    this->shader.setVec3("origin", view.origin);
+    this->shader.setVec3("xAxis", view.xAxis);
+    this->shader.setVec3("yAxis", view.yAxis);
+    this->shader.setVec2("auroraSize", passSize);
+    quad.draw();
+}
+
+const DynamicResolution::Metrics& DynamicResolution::getMetrics() const {
+    return metrics;
+}
+
+DynamicResolution::~DynamicResolution() {
+    glDeleteFramebuffers(1, &frameBuffer);
+    glDeleteTextures(1, &auroraTex);
+    glDeleteQueries(NUM_QUERY, queries);
+}
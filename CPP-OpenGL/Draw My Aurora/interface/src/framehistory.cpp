@@ -0,0 +1,206 @@
+//
+//  framehistory.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "framehistory.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+static const float GOLDEN_RATIO = 0.618034f; // offsets of successive frames are the farthest apart
+static const float NOISE_SIGMA = 1.5f; // in pixels, how far each one pushes others away
+
+/*
+ tile of blue noise made by void and cluster (Ulichney 1993): a few pixels are
+ spread out, and then each of the others is placed where pixels placed so far
+ are the sparsest, so that close values are far apart, even across tiles.
+ each is the order it is placed in, scaled to [0, 1)
+ */
+static vector<float> makeBlueNoise(const int size) {
+    const int numPixel = size * size;
+    vector<float> kernel(numPixel); // what a pixel adds to the energy of others, wrapping around
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            float dx = min(x, size - x), dy = min(y, size - y);
+            kernel[y * size + x] = exp(-(dx * dx + dy * dy) / (2.0f * NOISE_SIGMA * NOISE_SIGMA));
+        }
+    }
+    vector<bool> isPlaced(numPixel, false);
+    vector<float> energy(numPixel, 0.0f);
+    auto place = [&] (const int index, const bool value) {
+        isPlaced[index] = value;
+        int px = index % size, py = index / size;
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+                energy[y * size + x] += (value ? 1.0f : -1.0f)
+                    * kernel[(y - py + size) % size * size + (x - px + size) % size];
+    };
+    // the densest placed pixel, or the sparsest that is not placed
+    auto find = [&] (const bool isDensest) {
+        int best = -1;
+        for (int i = 0; i < numPixel; ++i)
+            if (isPlaced[i] == isDensest &&
+                (best < 0 || (isDensest ? energy[i] > energy[best] : energy[i] < energy[best]))) best = i;
+        return best;
+    };
+    
+    // a tenth of pixels are placed at random, and then moved from the densest
+    // place to the sparsest until they are even
+    mt19937 random(2018);
+    int numInitial = 0;
+    while (numInitial < numPixel / 10) {
+        int index = uniform_int_distribution<int>(0, numPixel - 1)(random);
+        if (!isPlaced[index]) {
+            place(index, true);
+            ++numInitial;
+        }
+    }
+    while (true) {
+        int densest = find(true);
+        place(densest, false);
+        int sparsest = find(false);
+        place(sparsest, true);
+        if (sparsest == densest) break;
+    }
+    vector<bool> initialPlaced = isPlaced;
+    vector<float> initialEnergy = energy;
+    
+    // those come first, the densest last, and then the others fill in
+    vector<float> noise(numPixel);
+    for (int rank = numInitial - 1; rank >= 0; --rank) {
+        int densest = find(true);
+        place(densest, false);
+        noise[densest] = rank;
+    }
+    isPlaced = initialPlaced;
+    energy = initialEnergy;
+    for (int rank = numInitial; rank < numPixel; ++rank) {
+        int sparsest = find(false);
+        place(sparsest, true);
+        noise[sparsest] = rank;
+    }
+    for (float& value : noise) value /= numPixel;
+    return noise;
+}
+
+FrameHistory::FrameHistory(const int textureUnit, const float stepScale, const int maxFrames,
+                           const int noiseSize):
+textureUnit(textureUnit), current(0), frameIndex(0), stepScale(stepScale), maxFrames(maxFrames),
+frameSize(0.0f), wasBlending(GL_FALSE) {
+    glGenFramebuffers(1, &frameBuffer);
+    glGenTextures(1, &colorTex);
+    glGenTextures(2, historyTex);
+    glGenTextures(1, &noiseTex);
+    
+    GLint activeUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glActiveTexture(GL_TEXTURE0 + textureUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, noiseTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, noiseSize, noiseSize, 0, GL_RED, GL_FLOAT,
+                 makeBlueNoise(noiseSize).data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glActiveTexture(activeUnit);
+}
+
+void FrameHistory::clear() {
+    const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    for (GLuint texture : historyTex) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texture, 0);
+        glClearBufferfv(GL_COLOR, 1, zero);
+    }
+}
+
+void FrameHistory::reset() {
+    if (frameSize.x > 0.0f) {
+        GLint prevFrameBuffer;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFrameBuffer);
+        clear();
+        glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
+    }
+}
+
+void FrameHistory::begin(const vec2& frameSize, const SkyTiles::View& view, const Shader& shader) {
+    GLint activeUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    mat3 toView = inverse(mat3(view.origin - view.cameraPos, view.xAxis, view.yAxis));
+    if (frameSize != this->frameSize) {
+        // history is linear color, and halfs would lose what each frame adds once many are averaged
+        this->frameSize = frameSize;
+        glBindTexture(GL_TEXTURE_2D, colorTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, frameSize.x, frameSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (GLuint texture : historyTex) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, frameSize.x, frameSize.y, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+        const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        clear();
+        toPrevView = toView;
+    }
+    
+    // the last frame drawn is read, and the other is drawn
+    glBindTexture(GL_TEXTURE_2D, historyTex[current]);
+    current = current == 0 ? 1 : 0;
+    glActiveTexture(GL_TEXTURE0 + textureUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, noiseTex);
+    glActiveTexture(activeUnit);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, historyTex[current], 0);
+    glViewport(0, 0, frameSize.x, frameSize.y);
+    // history is replaced rather than blended, or averages would be weighted by
+    // alpha. the frame is blended over the clear color, as it would be on the screen
+    wasBlending = glIsEnabledi(GL_BLEND, 1);
+    glDisablei(GL_BLEND, 1);
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glClearBufferfv(GL_COLOR, 0, clearColor);
+    
+    shader.use();
+    shader.setBool("accumulate", true);
+    shader.setFloat("stepScale", stepScale);
+    shader.setInt("history", textureUnit);
+    shader.setInt("blueNoise", textureUnit + 1);
+    shader.setFloat("jitterPhase", fmod(frameIndex * GOLDEN_RATIO, 1.0f));
+    shader.setMat3("toPrevView", toPrevView);
+    shader.setFloat("maxHistory", maxFrames);
+    toPrevView = toView;
+    frameIndex = (frameIndex + 1) % (1 << 16);
+}
+
+void FrameHistory::end(const Shader& shader, const GLuint prevFrameBuffer, const vec4& prevViewPort) {
+    shader.setBool("accumulate", false);
+    shader.setFloat("stepScale", 1.0f);
+    if (wasBlending) glEnablei(GL_BLEND, 1);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prevFrameBuffer);
+    glBlitFramebuffer(0, 0, frameSize.x, frameSize.y, prevViewPort.x, prevViewPort.y,
+                      prevViewPort.x + prevViewPort.z, prevViewPort.y + prevViewPort.w,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
+    glViewport(prevViewPort.x, prevViewPort.y, prevViewPort.z, prevViewPort.w);
+}
+
+FrameHistory::~FrameHistory() {
+    glDeleteFramebuffers(1, &frameBuffer);
+    glDeleteTextures(1, &colorTex);
+    glDeleteTextures(2, historyTex);
+    glDeleteTextures(1, &noiseTex);
+}
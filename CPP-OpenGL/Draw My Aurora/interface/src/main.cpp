@@ -6,16 +6,94 @@
 //  Copyright © 2018 Pujun Lun. All rights reserved.
 //
 
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "drawpath.hpp"
 
 using namespace std;
 
+static void printStats(const string& name, const RayMarch::Stats& stats) {
+    cout << name << ": " << stats.milliseconds << " ms, " << stats.numRay / stats.milliseconds / 1000.0
+         << "M rays/s, " << (double)stats.numSample / stats.numRay << " samples/ray" << endl;
+}
+
+/*
+ renders a field file on the CPU into a binary PPM, and reports how fast. if
+ packets of rays are supported, it is also rendered one ray at a time, and
+ both should give the same image
+ */
+static int renderStill(const string& fieldPath, const string& imagePath, const glm::ivec2& size) {
+    int numThread = thread::hardware_concurrency();
+    vector<unsigned char> image;
+    RayMarch::Stats stats = Aurora::renderStill(fieldPath, size, image, numThread);
+    DistanceField::Isa isa = DistanceField::bestIsa();
+    if (isa >= DistanceField::Isa::AVX2) {
+        vector<unsigned char> scalarImage;
+        RayMarch::Stats scalarStats = Aurora::renderStill(fieldPath, size, scalarImage, numThread,
+                                                          DistanceField::Isa::Scalar);
+        printStats("scalar", scalarStats);
+        printStats(isa == DistanceField::Isa::AVX512 ? "AVX-512" : "AVX2", stats);
+        cout << "speedup: " << scalarStats.milliseconds / stats.milliseconds << "x"
+             << (image == scalarImage ? "" : ", but images differ") << endl;
+    } else {
+        printStats("scalar", stats);
+    }
+    
+    ofstream file(imagePath, ios::binary);
+    file << "P6\n" << size.x << " " << size.y << "\n255\n";
+    for (int y = size.y - 1; y >= 0; --y)
+        file.write((const char *)image.data() + (size_t)y * size.x * 3, size.x * 3);
+    if (!file) throw runtime_error("Failed to write " + imagePath);
+    return 0;
+}
+
+/*
+ pass --gpu-field to generate distance fields with compute shaders,
+ --radiance-cache to look around from a cube map of aurora, --accumulate to
+ average frames that take fewer samples, --dynamic-resolution to march rays
+ for fewer pixels when they take too long, or
+ --still <field> <image.ppm> [width height] to render a field left in the
+ cache directory without opening a window, or
+ --count-samples [width height [latitude]] to render aurora of the default
+ paths once and print how many samples rays take per pixel
+ */
 int main(int argc, const char * argv[]) {
+    Aurora::FieldEngine fieldEngine = Aurora::FieldEngine::CPU;
+    bool useRadianceCache = false, useAccumulation = false, useDynamicResolution = false;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--gpu-field") fieldEngine = Aurora::FieldEngine::GPU;
+        else if (string(argv[i]) == "--radiance-cache") useRadianceCache = true;
+        else if (string(argv[i]) == "--accumulate") useAccumulation = true;
+        else if (string(argv[i]) == "--dynamic-resolution") useDynamicResolution = true;
+    }
+    
+    if (argc >= 4 && string(argv[1]) == "--still") {
+        glm::ivec2 size = argc >= 6 ? glm::ivec2(atoi(argv[4]), atoi(argv[5])) : glm::ivec2(1280, 720);
+        try {
+            return renderStill(argv[2], argv[3], size);
+        } catch (exception& e) {
+            cerr << e.what() << endl;
+            return -1;
+        }
+    }
+    
     try {
-        DrawPath pathEditor;
-        pathEditor.mainLoop();
+        DrawPath pathEditor(fieldEngine, useRadianceCache, useAccumulation, useDynamicResolution);
+        if (argc >= 2 && string(argv[1]) == "--count-samples") {
+            glm::vec2 size = argc >= 4 ? glm::vec2(atoi(argv[2]), atoi(argv[3])) : glm::vec2(1280, 720);
+            float latitude = argc >= 5 ? atof(argv[4]) : 65.0f; // between the first two paths
+            Aurora::SampleCounts counts = pathEditor.countSamples(size, latitude);
+            cout << "samples per pixel: " << counts.byField << " by distance field only, "
+                 << counts.withinSpans << " within spans" << endl;
+        } else {
+            pathEditor.mainLoop();
+        }
         glfwTerminate();
         return 0;
     } catch (exception& e) {
@@ -0,0 +1,144 @@
+//
+//  radiancecache.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "radiancecache.hpp"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+using namespace glm;
+
+// the direction of the center of each face, and where x and y of its NDC go,
+// as cube maps are sampled (+X, -X, +Y, -Y, +Z, -Z)
+static const vec3 FACE_AXES[6][3] = {
+    { vec3( 1.0f,  0.0f,  0.0f), vec3( 0.0f,  0.0f, -1.0f), vec3( 0.0f, -1.0f,  0.0f) },
+    { vec3(-1.0f,  0.0f,  0.0f), vec3( 0.0f,  0.0f,  1.0f), vec3( 0.0f, -1.0f,  0.0f) },
+    { vec3( 0.0f,  1.0f,  0.0f), vec3( 1.0f,  0.0f,  0.0f), vec3( 0.0f,  0.0f,  1.0f) },
+    { vec3( 0.0f, -1.0f,  0.0f), vec3( 1.0f,  0.0f,  0.0f), vec3( 0.0f,  0.0f, -1.0f) },
+    { vec3( 0.0f,  0.0f,  1.0f), vec3( 1.0f,  0.0f,  0.0f), vec3( 0.0f, -1.0f,  0.0f) },
+    { vec3( 0.0f,  0.0f, -1.0f), vec3(-1.0f,  0.0f,  0.0f), vec3( 0.0f, -1.0f,  0.0f) },
+};
+
+RadianceCache::RadianceCache(const int textureUnit, const int baseSize, const int maxSize,
+                             const int pixelsPerFrame):
+shader("aurora.vs", "radiance.fs"), textureUnit(textureUnit), baseSize(baseSize),
+maxSize(max(maxSize, baseSize)), pixelsPerFrame(pixelsPerFrame),
+frontSize(0), backSize(0), face(0), row(0), isValid(false) {
+    glGenFramebuffers(1, &frameBuffer);
+    glGenTextures(2, cubeMap);
+    GLint activeUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    for (int i = 0; i < 2; ++i) {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap[i]);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glActiveTexture(activeUnit);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); // or edges of faces would show
+    
+    shader.use();
+    shader.setInt("radiance", textureUnit);
+}
+
+void RadianceCache::allocate(const int index, const int size) {
+    GLint activeUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap[index]);
+    for (int i = 0; i < 6; ++i)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8, size, size, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glActiveTexture(activeUnit);
+}
+
+void RadianceCache::invalidate() {
+    isValid = false;
+}
+
+void RadianceCache::drawRows(const int end, const SkyTiles::View& view, const PrepareFunc& prepare,
+                             const DrawFunc& draw) {
+    SkyTiles::View faceView { view.cameraPos, view.cameraPos + FACE_AXES[face][0],
+                              FACE_AXES[face][1], FACE_AXES[face][2], view.shell };
+    vec2 frameSize = vec2(backSize);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                           cubeMap[1], 0);
+    glViewport(0, 0, backSize, backSize);
+    if (row == 0) prepare(frameSize, faceView, frameBuffer);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, row, backSize, end - row);
+    draw(faceView);
+    glDisable(GL_SCISSOR_TEST);
+    
+    row = end;
+    if (row < backSize) return;
+    row = 0;
+    if (++face < 6) return;
+    
+    // the back cube is done, and then a sharper one is drawn behind it
+    face = 0;
+    swap(cubeMap[0], cubeMap[1]);
+    frontSize = backSize;
+    backSize = backSize * 2 <= maxSize ? backSize * 2 : 0;
+    if (backSize > 0) allocate(1, backSize);
+}
+
+void RadianceCache::refine(const SkyTiles::View& view, const PrepareFunc& prepare, const DrawFunc& draw,
+                           const GLuint prevFrameBuffer, const vec4& prevViewPort) {
+    // what aurora.fs outputs is kept as it is, alpha included, and blended when
+    // the cube is shown, as it would have been on the screen
+    GLboolean isBlending = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    if (!isValid) {
+        // the coarsest cube is drawn at once, so that there is always one to show
+        isValid = true;
+        frontSize = 0;
+        backSize = baseSize;
+        face = 0;
+        row = 0;
+        allocate(1, backSize);
+        while (frontSize == 0) drawRows(backSize, view, prepare, draw);
+    } else if (backSize > 0) {
+        drawRows(min(row + max(pixelsPerFrame / backSize, 1), backSize), view, prepare, draw);
+    }
+    if (isBlending) glEnable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
+    glViewport(prevViewPort.x, prevViewPort.y, prevViewPort.z, prevViewPort.w);
+}
+
+void RadianceCache::draw(const SkyTiles::View& view) const {
+    GLint activeUnit;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap[0]);
+    glActiveTexture(activeUnit);
+    shader.use();
+    shader.setVec3("cameraPos", view.cameraPos);
+    shader.setVec3("origin", view.origin);
+    shader.setVec3("xAxis", view.xAxis);
+    shader.setVec3("yAxis", view.yAxis);
+    quad.draw();
+}
+
+int RadianceCache::getSize() const {
+    return isValid ? frontSize : 0;
+}
+
+bool RadianceCache::isRefined() const {
+    return isValid && backSize == 0;
+}
+
+RadianceCache::~RadianceCache() {
+    glDeleteFramebuffers(1, &frameBuffer);
+    glDeleteTextures(2, cubeMap);
+}
@@ -0,0 +1,146 @@
+//
+//  ribbons.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "ribbons.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+static const float MISS_DISTANCE = 100.0f; // the same as miss_t of aurora.fs
+
+Ribbons::Ribbons():
+shader("ribbon.vs", "ribbon.fs"), numVertex(0), frameSize(0.0f) {
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    glGenFramebuffers(1, &frameBuffer);
+    glGenTextures(1, &spanTex);
+}
+
+// where the line from the south pole through a point of the map plane (y = 1)
+// reaches radius (> 1), which only rises along the line from there on
+static vec3 liftToShell(const vec2& plane, const float radius) {
+    vec3 line = vec3(plane.x, 2.0f, plane.y);
+    float lengthSq = dot(line, line);
+    float scale = (2.0f + sqrt(4.0f + lengthSq * (radius * radius - 1.0f))) / lengthSq;
+    return vec3(0.0f, -1.0f, 0.0f) + line * scale;
+}
+
+void Ribbons::setPaths(const vector<DistanceField::Polyline>& paths, const float halfWidth,
+                       const vec2& shell) {
+    vector<vec3> vertices;
+    for (const DistanceField::Polyline& path : paths) {
+        // a lone point is a segment of no length
+        int numSegment = max((int)path.size() - 1, min((int)path.size(), 1));
+        for (int i = 0; i < numSegment; ++i) {
+            const DistanceField::Vec2& p0 = path[i];
+            const DistanceField::Vec2& p1 = path[min(i + 1, (int)path.size() - 1)];
+            vec2 a = vec2(p0.x, p0.y) * 4.0f - 2.0f, b = vec2(p1.x, p1.y) * 4.0f - 2.0f;
+            vec2 along = length(b - a) > 0.0f ? normalize(b - a) * halfWidth : vec2(halfWidth, 0.0f);
+            vec2 across = vec2(-along.y, along.x);
+            // round ends of the segment are also covered
+            vec2 corners[] = { a - along - across, b + along - across, b + along + across, a - along + across };
+            
+            // caps are flat, and their triangles come no closer to the center
+            // than r * cos(angle), where angle is the widest between corners.
+            // the higher cap is lifted by the square of that, since corners
+            // also move a little when lifted
+            vec3 low[4], high[4];
+            float minCos = 1.0f;
+            for (int j = 0; j < 4; ++j) {
+                low[j] = liftToShell(corners[j], shell.x);
+                high[j] = normalize(liftToShell(corners[j], shell.y));
+            }
+            for (int j = 0; j < 4; ++j)
+                for (int k = j + 1; k < 4; ++k)
+                    minCos = min(minCos, dot(high[j], high[k]));
+            float radius = shell.y / max(minCos * minCos, 0.25f);
+            for (int j = 0; j < 4; ++j) high[j] = liftToShell(corners[j], radius);
+            
+            // walls lie in planes through the pole, and caps close the box
+            for (int j = 0; j < 4; ++j) {
+                int k = (j + 1) % 4;
+                vertices.insert(vertices.end(), { low[j], low[k], high[k], low[j], high[k], high[j] });
+            }
+            vertices.insert(vertices.end(), { low[0], low[1], low[2], low[0], low[2], low[3] });
+            vertices.insert(vertices.end(), { high[0], high[2], high[1], high[0], high[3], high[2] });
+        }
+    }
+    numVertex = (int)vertices.size();
+    
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Ribbons::operator()(const vec2& frameSize, const SkyTiles::View& view,
+                         const GLuint prevFrameBuffer, const vec4& prevViewPort) {
+    if (frameSize != this->frameSize) {
+        this->frameSize = frameSize;
+        GLint prevTexture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
+        glBindTexture(GL_TEXTURE_2D, spanTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, frameSize.x, frameSize.y, 0, GL_RG, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, prevTexture);
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, spanTex, 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glViewport(0, 0, frameSize.x, frameSize.y);
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glClearColor(MISS_DISTANCE, MISS_DISTANCE, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    
+    // both the nearest entry and the farthest exit are kept by GL_MIN, whichever
+    // faces they are on, and boxes are closed, so spans hold every curtain
+    GLboolean isBlending = glIsEnabled(GL_BLEND), isCulling = glIsEnabled(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_MIN);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_CLIP_DISTANCE0);
+    shader.use();
+    shader.setVec3("cameraPos", view.cameraPos);
+    shader.setVec3("normal", normalize(view.cameraPos));
+    shader.setMat3("toView", inverse(mat3(view.origin - view.cameraPos, view.xAxis, view.yAxis)));
+    glBindVertexArray(VAO);
+    for (bool isMirrored : { false, true }) {
+        shader.setBool("isMirrored", isMirrored);
+        glDrawArrays(GL_TRIANGLES, 0, numVertex);
+    }
+    glBindVertexArray(0);
+    glDisable(GL_CLIP_DISTANCE0);
+    glBlendEquation(GL_FUNC_ADD);
+    if (!isBlending) glDisable(GL_BLEND);
+    if (isCulling) glEnable(GL_CULL_FACE);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFrameBuffer);
+    glViewport(prevViewPort.x, prevViewPort.y, prevViewPort.z, prevViewPort.w);
+}
+
+GLuint Ribbons::getSpans() const {
+    return spanTex;
+}
+
+Ribbons::~Ribbons() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteFramebuffers(1, &frameBuffer);
+    glDeleteTextures(1, &spanTex);
+}
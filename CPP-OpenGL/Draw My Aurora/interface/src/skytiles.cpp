@@ -0,0 +1,120 @@
+//
+//  skytiles.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "skytiles.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <glm/gtc/constants.hpp>
+
+using namespace std;
+using namespace glm;
+
+static const int MAX_CONE_STEP = 64; // cones that take more steps are marched anyway
+
+SkyTiles::SkyTiles(const int tileSize):
+tileSize(tileSize), numTile(0), numMarch(0) {
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// how far a ray goes before leaving a sphere, if it starts inside at distance
+// camera from the center, and sinElevation is the sine of its angle above horizon
+static float exitDistance(const float camera, const float radius, const float sinElevation) {
+    float sq = radius * radius - camera * camera * (1.0f - sinElevation * sinElevation);
+    return -camera * sinElevation + sqrt(max(sq, 0.0f));
+}
+
+SkyTiles::Kind SkyTiles::classify(const View& view, const vec2& ndcMin, const vec2& ndcMax,
+                                  const LeapFunc& leap) const {
+    vec3 normal = normalize(view.cameraPos);
+    auto getDirection = [&] (const vec2& ndc) {
+        return normalize(view.origin + ndc.x * view.xAxis + ndc.y * view.yAxis - view.cameraPos);
+    };
+    vec3 axis = getDirection((ndcMin + ndcMax) * 0.5f);
+    vec3 corners[] = {
+        getDirection(ndcMin), getDirection(vec2(ndcMax.x, ndcMin.y)),
+        getDirection(vec2(ndcMin.x, ndcMax.y)), getDirection(ndcMax),
+    };
+    bool isGround = dot(axis, normal) <= 0.0f;
+    float angle = 0.0f; // half angle of the cone
+    for (const vec3& corner : corners) {
+        if ((dot(corner, normal) <= 0.0f) != isGround) return Kind::March;
+        angle = max(angle, acos(min(dot(corner, axis), 1.0f)));
+    }
+    if (isGround) axis -= 2.0f * dot(axis, normal) * normal;
+    
+    // no ray of the cone starts earlier than the steepest one leaves the lower
+    // sphere, or ends later than the flattest one leaves the higher sphere
+    float camera = length(view.cameraPos);
+    float elevation = asin(clamp(dot(axis, normal), -1.0f, 1.0f));
+    float t = exitDistance(camera, view.shell.x, sin(min(elevation + angle, half_pi<float>())));
+    float end = exitDistance(camera, view.shell.y, sin(max(elevation - angle, 0.0f)));
+    
+    // points of the cone at distance s from the camera are within s * angle from
+    // the center ray, so stepping the center from t to t + delta keeps all points
+    // passed within (t + delta) * angle + delta of where it was
+    for (int step = 0; t < end; ++step) {
+        float clearance = leap(view.cameraPos + axis * t) - t * angle;
+        if (clearance <= 0.0f || step == MAX_CONE_STEP) return Kind::March;
+        t += clearance / (1.0f + angle);
+    }
+    return Kind::Sky;
+}
+
+void SkyTiles::operator()(const vec2& frameSize, const View& view, const LeapFunc& leap) {
+    int numTileX = (int)ceil(frameSize.x / tileSize), numTileY = (int)ceil(frameSize.y / tileSize);
+    vector<float> march, sky;
+    for (int y = 0; y < numTileY; ++y) {
+        for (int x = 0; x < numTileX; ++x) {
+            vec2 ndcMin = vec2(x, y) * (float)tileSize / frameSize * 2.0f - 1.0f;
+            vec2 ndcMax = min(vec2(x + 1, y + 1) * (float)tileSize / frameSize, vec2(1.0f)) * 2.0f - 1.0f;
+            vector<float>& quads = classify(view, ndcMin, ndcMax, leap) == Kind::March ? march : sky;
+            quads.insert(quads.end(), {
+                ndcMin.x, ndcMin.y,  ndcMax.x, ndcMin.y,  ndcMax.x, ndcMax.y,
+                ndcMin.x, ndcMin.y,  ndcMax.x, ndcMax.y,  ndcMin.x, ndcMax.y,
+            });
+        }
+    }
+    numTile = numTileX * numTileY;
+    numMarch = (int)march.size() / 12;
+    
+    march.insert(march.end(), sky.begin(), sky.end());
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, march.size() * sizeof(float), march.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SkyTiles::draw(const Kind kind) const {
+    int first = kind == Kind::March ? 0 : numMarch;
+    int count = kind == Kind::March ? numMarch : numTile - numMarch;
+    if (count == 0) return;
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, first * 6, count * 6);
+    glBindVertexArray(0);
+}
+
+int SkyTiles::getNumTile() const {
+    return numTile;
+}
+
+int SkyTiles::getNumSkipped() const {
+    return numTile - numMarch;
+}
+
+SkyTiles::~SkyTiles() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+}
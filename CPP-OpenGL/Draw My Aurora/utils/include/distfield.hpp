@@ -9,30 +9,271 @@
 #ifndef distfield_hpp
 #define distfield_hpp
 
-#include <immintrin.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace DistanceField {
     struct Point {
         int dx, dy;
         int distSq() const { return dx * dx + dy * dy; }
+        bool operator==(const Point& other) const { return dx == other.dx && dy == other.dy; }
     };
     
+    /*
+     SSEDT: 8-point sequential signed euclidean distance transform (two sweeps,
+     approximate, and only the wavefront within a row can run in parallel,
+     which hands carries around rather than saving time on more cores)
+     Exact: separable euclidean distance transform (Felzenszwalb-Huttenlocher),
+     first along columns and then along rows, both in parallel. use this one
+     with more than one thread
+     */
+    enum class Engine { SSEDT, Exact };
+    
+    /*
+     instruction sets that the SSEDT sweep kernel may use. all of them produce
+     the same result, so the best one supported by the CPU is used by default
+     */
+    enum class Isa { Scalar, SSE41, AVX2, AVX512 }; // AVX-512 means F and BW
+    Isa bestIsa();
+    
+    // IEEE 754 half precision float, can be uploaded as GL_HALF_FLOAT
+    struct Half { uint16_t bits; };
+    // magnitude is rounded down (mantissa truncated), and saturates at 65504
+    void encode(const float value, Half& out);
+    float decode(const Half value);
+    
+    struct Rect { int x, y, width, height; };
+    
+    // int16 distances are in 1/16 pixels, so they cover +-2048 pixels
+    static const int INT16_SUBPIXEL = 16;
+    
+    /*
+     numThread: how many threads are used for generating the field
+     (1 means running sequentially; the result is identical either way)
+     isa: throws if it is not supported by the CPU
+     */
     class Generator {
     public:
-        Generator(const int width, const int height);
+        // wall time of a pass of the last call (passes are listed in the order they ran)
+        struct Pass { const char* name; double milliseconds; };
+        
+        Generator(const int width, const int height, const int numThread = 1,
+                  const Engine engine = Engine::SSEDT, const Isa isa = bestIsa());
+        // distance in pixels clamped to 255, stored as (255 - distance) in place
         void operator()(unsigned char* image);
+        /*
+         signed distance in pixels from the boundary of paths (pixels >= 128 in
+         mask), negative inside paths. if gradient is not null, central
+         differences of the field are written to it as interleaved (x, y) pairs
+         (int16 gradients are normalized, i.e. 32767 means 1.0).
+         magnitudes are always rounded down, so they are safe for ray marching
+         */
+        void operator()(const unsigned char* mask, int16_t* field, int16_t* gradient = nullptr);
+        void operator()(const unsigned char* mask, Half* field, Half* gradient = nullptr);
+        /*
+         incremental version of the above: field (and gradient) should hold the
+         output of the previous call with the same maxDistance, and dirty should
+         bound all pixels of mask that changed since then. distances are clamped
+         to maxDistance, so only pixels within it from dirty are recomputed
+         (dirty should cover the whole image for the first call)
+         */
+        void update(const unsigned char* mask, const Rect& dirty, const float maxDistance,
+                    int16_t* field, int16_t* gradient = nullptr);
+        void update(const unsigned char* mask, const Rect& dirty, const float maxDistance,
+                    Half* field, Half* gradient = nullptr);
+        const std::vector<Pass>& getPasses() const;
         ~Generator();
     private:
+        /*
+         image is split into numThread vertical segments, and each thread sweeps
+         its own segment row by row (a wavefront along rows). a chain of
+         comparisons may cross segments, so each segment first runs its chain
+         locally, and then corrects the head of it once the carry from the
+         neighbour segment is known. counters and carries are published here
+         (padded to avoid false sharing), and neighbours that wait long sleep
+         until counters change. each row needs the whole previous row, so only
+         work within rows is shared, and the carries of both chains go through
+         every segment once per row (see generateSDF(int))
+         */
+        struct Segment {
+            int begin, end;
+            std::atomic<int> numChained, numFinished, numWaiting;
+            Point firstCarry, secondCarry;
+            std::mutex mutex;
+            std::condition_variable counted;
+            char padding[64];
+        };
         int imageWidth, imageHeight;
-        int gridWidth, gridHeight, numPoint;
-        Point* grid;
+        int gridWidth, gridHeight, numPoint, numThread;
+        Engine engine;
+        // for each pixel in [begin, end) of row, replaces it with the closest one
+        // of it and three candidates from neighbours (row of pixels above or below)
+        void (*compareRow)(int16_t* rowX, int16_t* rowY, const int16_t* neighboursX,
+                           const int16_t* neighboursY, const int begin, const int end,
+                           const int dy);
+        // used by SSEDT, dx and dy are stored separately, and each row starts
+        // at 64-byte boundaries (gridWidth is the stride of rows)
+        int16_t *gridX, *gridY;
+        int* distSq; // used by Exact
+        std::vector<Segment> segments;
+        std::vector<Pass> passes;
+        std::chrono::steady_clock::time_point passStart;
+        void resetPasses();
+        void finishPass(const char* name);
         inline Point get(const int x, const int y);
         inline void put(const int x, const int y, const Point& p);
-        inline Point groupCompare(Point other, const int x, const int y,
-                                  const __m256i& offsets);
         inline Point singleCompare(Point other, const int x, const int y,
                                    const int offsetx, const int offsety);
-        void generateSDF();
+        inline int getDistSq(const int x, const int y);
+        void transform(const unsigned char* image, const bool inverted, const Rect& window);
+        template <typename T>
+        void generateSigned(const unsigned char* mask, T* field, T* gradient,
+                            const Rect& dirty, const float maxDistance);
+        void generateSDF(const Rect& window);
+        void generateSDF(const int index);
+        void generateEDT(const unsigned char* image, const bool inverted, const Rect& window);
+        void runInParallel(const int numTask, const std::function<void (int, int)>& taskFunc);
+    };
+    
+    /*
+     the same SSEDT as Generator, streamed strip by strip for images too large
+     to hold in memory (neither the image nor the grid is ever held as a whole).
+     pass 0 goes down and writes each row to a scratch file, and pass 1 reads
+     them back going up, so the output is written from the last strip to the
+     first one. the scratch file is memory-mapped one strip at a time, and a
+     strip (including its mask and output) takes at most stripBudget bytes,
+     unless a single row is larger than that. results are identical to those
+     of Generator without gradients, but everything runs on this thread
+     */
+    class StripGenerator {
+    public:
+        // called with rows [y, y + numRow) of the image, each of width pixels
+        template <typename T>
+        using Strip = std::function<void (const int y, const int numRow, T* rows)>;
+        
+        // scratchPath: file to create (removed as soon as it is opened)
+        StripGenerator(const int width, const int height, const size_t stripBudget,
+                       const std::string& scratchPath, const Isa isa = bestIsa());
+        // mask (or image) is read from read, and the output is passed to write
+        void operator()(const Strip<unsigned char>& read, const Strip<const unsigned char>& write);
+        void operator()(const Strip<unsigned char>& read, const Strip<const int16_t>& write);
+        void operator()(const Strip<unsigned char>& read, const Strip<const Half>& write);
+        ~StripGenerator();
+    private:
+        int imageWidth, imageHeight;
+        int rowWidth; // stride of rows in buffers, including padding
+        size_t stripBudget;
+        int scratchFile;
+        void (*compareRow)(int16_t* rowX, int16_t* rowY, const int16_t* neighboursX,
+                           const int16_t* neighboursY, const int begin, const int end,
+                           const int dy);
+        // (dx, dy) of the previous row, current row and initial last row,
+        // for the distance to inside and to outside (the latter if signed)
+        int16_t* rows;
+        inline int16_t* getRow(const int slot, const int channel, const int axis);
+        template <typename T>
+        void generate(const Strip<unsigned char>& read, const Strip<const T>& write);
+    };
+    
+    // a point in pixels of the field (pixel (x, y) covers [x, x + 1) * [y, y + 1))
+    struct Vec2 { float x, y; };
+    using Polyline = std::vector<Vec2>;
+    
+    /*
+     signed distance field measured from polylines rather than from a mask:
+     paths are all points within halfWidth from any polyline (a single point
+     makes a dot), so distances are exact up to float precision instead of
+     being measured between pixels. segments are put into a uniform grid of
+     cells, and each tile of cellSize^2 pixels only measures segments found in
+     nearby cells. tiles run in parallel, and distances are clamped to
+     maxDistance (the same as Generator::update() does)
+     */
+    class SegmentField {
+    public:
+        SegmentField(const int width, const int height, const float maxDistance,
+                     const int numThread = 1, const int cellSize = 16);
+        // gradients are unit vectors pointing away from paths (zero where clamped)
+        void operator()(const std::vector<Polyline>& polylines, const float halfWidth,
+                        int16_t* field, int16_t* gradient = nullptr);
+        void operator()(const std::vector<Polyline>& polylines, const float halfWidth,
+                        Half* field, Half* gradient = nullptr);
+    private:
+        friend class NarrowBand;
+        struct Segment { float x, y, dx, dy, invLengthSq; };
+        // working space of one thread when looking for segments close to a tile
+        struct Search {
+            std::vector<int> visited, found, candidates, nearby;
+            std::vector<float> distance;
+            int stamp;
+            Search(const int numSegment): visited(numSegment, 0), stamp(0) {}
+        };
+        int imageWidth, imageHeight, numThread, cellSize, numCellX, numCellY;
+        float maxDistance, halfWidth;
+        std::vector<Segment> segments;
+        // segments overlapping cell i are cellSegments[cellBegin[i], cellBegin[i + 1]),
+        // and rings of cells around it before firstRing[i] have no segment
+        std::vector<int> cellBegin, cellSegments, firstRing;
+        static inline float getDistSq(const Segment& segment, const float x, const float y,
+                                      float& offsetX, float& offsetY);
+        void build(const std::vector<Polyline>& polylines, const float halfWidth);
+        bool findCandidates(const int cellX, const int cellY, Search& search) const;
+        template <typename T>
+        void measureTile(const int cellX, const int cellY, Search& search,
+                         T* field, const int stride, T* gradient) const;
+        template <typename T>
+        void generate(const std::vector<Polyline>& polylines, const float halfWidth,
+                      T* field, T* gradient);
+    };
+    
+    /*
+     narrow band of the signed distance field (as Generator makes) clamped to
+     maxDistance. the image is split into square tiles, and only tiles that may
+     be closer than maxDistance to paths are computed (in the same way as the
+     exact engine) and packed into an atlas. any other tile is far away, i.e.
+     all its pixels are maxDistance. hence memory and time scale with the length
+     of paths rather than the area of image, except for one scan of the mask
+     */
+    class NarrowBand {
+    public:
+        // position of a tile in the atlas (in tiles), or FAR_TILE if far away
+        struct Slot { int16_t x, y; };
+        static const int16_t FAR_TILE = -1;
+        
+        NarrowBand(const int width, const int height, const int tileSize,
+                   const float maxDistance, const int numThread = 1);
+        void operator()(const unsigned char* mask);
+        // measured from polylines instead (see SegmentField), without any mask
+        void operator()(const std::vector<Polyline>& polylines, const float halfWidth);
+        int getNumTileX() const;
+        int getNumTileY() const;
+        int getNumBandTile() const;
+        // numTileX * numTileY slots, row by row
+        const std::vector<Slot>& getSlots() const;
+        // each tile takes (tileSize + 2)^2 texels in the atlas. the outermost
+        // texels are copied from neighbours, so that tiles can be filtered
+        int getAtlasWidth() const;
+        int getAtlasHeight() const;
+        const Half* getAtlas() const;
+    private:
+        int imageWidth, imageHeight, tileSize, numTileX, numTileY, numThread;
+        float maxDistance;
+        int atlasTileX, atlasTileY; // number of tiles in each row and column of atlas
+        std::vector<Slot> slots;
+        std::vector<int> bandTiles; // indices of tiles in the band, row by row
+        std::vector<int> distSq; // tileSize^2 per band tile, in the order of bandTiles
+        std::vector<Half> atlas;
+        SegmentField segmentField; // cells are the same as tiles
+        void allocate(const std::vector<char>& inBand);
+        inline int* getTile(const int tileX, const int tileY);
+        void transform(const unsigned char* mask, const bool inverted);
+        void writeAtlas(const unsigned char* mask, const bool inverted);
+        void fillBorders();
     };
 }
 
@@ -0,0 +1,63 @@
+//
+//  fieldcache.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef fieldcache_hpp
+#define fieldcache_hpp
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ content-addressed cache of generated fields (any bytes really), keyed by a
+ hash of whatever they are generated from. recently used fields are kept in
+ memory within memoryBudget bytes. if directory is not empty, fields are also
+ written there, and mapped back into memory when not found in memory. files
+ used least recently are removed once they take more than diskBudget bytes.
+ failing to read or write files only makes them missed. not thread-safe
+ */
+class FieldCache {
+public:
+    using Key = uint64_t;
+    
+    // bytes of a field, either owned or mapped from a file (read only)
+    class Blob {
+    public:
+        const char* getData() const;
+        size_t getSize() const;
+        ~Blob();
+    private:
+        friend class FieldCache;
+        std::vector<char> owned;
+        void* mapped;
+        size_t mappedSize;
+        Blob(): mapped(nullptr), mappedSize(0) {}
+    };
+    
+    // FNV-1a of data, chained from seed (the hash of previous data)
+    static Key hash(const void* data, const size_t size, const Key seed = 14695981039346656037ull);
+    
+    FieldCache(const size_t memoryBudget, const std::string& directory = "",
+               const size_t diskBudget = 0);
+    // null if neither in memory nor on disk
+    std::shared_ptr<const Blob> find(const Key key);
+    std::shared_ptr<const Blob> insert(const Key key, std::vector<char>&& data);
+private:
+    size_t memoryBudget, diskBudget, memorySize;
+    std::string directory;
+    std::list<std::pair<Key, std::shared_ptr<const Blob>>> recent; // most recent first
+    std::unordered_map<Key, decltype(recent)::iterator> entries;
+    std::string getPath(const Key key) const;
+    void keep(const Key key, const std::shared_ptr<const Blob>& blob);
+    void trimDisk();
+};
+
+#endif /* fieldcache_hpp */
@@ -0,0 +1,70 @@
+//
+//  jumpflood.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef jumpflood_hpp
+#define jumpflood_hpp
+
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "distfield.hpp"
+#include "shader.hpp"
+
+namespace DistanceField {
+    /*
+     jump flooding (JFA+2) in compute shaders, which reads the mask from a
+     texture and writes the field to another one, without any readback. each
+     pixel keeps the closest inside and outside pixels that it has heard of,
+     and learns from its 8 neighbours at step away, with step halving from half
+     of the image down to 1, and then once more at 2 and 1 to fix most errors of
+     plain jump flooding. the result is therefore approximate, like SSEDT.
+     requires OpenGL 4.3, and the context should be current whenever used.
+     the current program and the texture bound to the active unit are changed
+     */
+    class JumpFlood {
+    public:
+        // whether compute shaders are available in the current context
+        static bool isSupported();
+        
+        // numLayer: how many layers of mask are made into one atlas
+        JumpFlood(const int width, const int height, const int tileSize, const float maxDistance,
+                  const int numLayer = 1);
+        // the same as Generator::operator()(unsigned char*), mainly for validation
+        // (the image is uploaded and read back, so this waits for the GPU)
+        void operator()(unsigned char* image);
+        /*
+         the same signed field as NarrowBand::operator()(const unsigned char*),
+         but every tile is in the band (see getSlots()). mask: GL_TEXTURE_2D_ARRAY
+         of numLayer layers, paths are texels >= 0.5 in the red channel. atlas:
+         GL_R16F texture of getAtlasWidth() x getAtlasHeight(), written as images
+         (the caller should issue a barrier before reading it in other ways)
+         */
+        void operator()(const GLuint mask, const GLuint atlas);
+        int getNumTileX() const;
+        int getNumTileY() const;
+        int getAtlasWidth() const;
+        int getAtlasHeight() const;
+        // numTileX * numTileY slots of each layer. tile (x, y) of layer i is
+        // always at slot (x, y + i * numTileY)
+        const std::vector<NarrowBand::Slot>& getSlots() const;
+        ~JumpFlood();
+    private:
+        int imageWidth, imageHeight, tileSize, numTileX, numTileY, numLayer;
+        float maxDistance;
+        Shader shader;
+        GLuint seeds[2]; // read from one and written to the other in turn
+        GLuint maskTex, byteTex; // only used for validation (mask has one layer)
+        std::vector<NarrowBand::Slot> slots;
+        void dispatch(const int pass, const int width, const int height);
+        // returns which of seeds holds the result
+        int flood(const GLuint mask, const int layer);
+    };
+}
+
+#endif /* jumpflood_hpp */
@@ -33,6 +33,8 @@ namespace Loader {
     void setFlipVertically(const bool shouldFlip);
     void set2DTexParameter(const GLenum wrapMode, const GLenum interpMode);
     GLuint loadTexture(const std::string& path, const bool gammaCorrection);
+    // bytes of an image file without OpenGL, flipped as loadTexture() would
+    std::vector<unsigned char> readImage(const std::string& path, int& width, int& height, int& channel);
     GLuint loadCubemap(const std::string& path,
                        const std::vector<std::string>& filename,
                        const bool gammaCorrection);
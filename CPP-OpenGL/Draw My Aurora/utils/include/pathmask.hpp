@@ -0,0 +1,43 @@
+//
+//  pathmask.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef pathmask_hpp
+#define pathmask_hpp
+
+#include <vector>
+
+#include "distfield.hpp"
+
+namespace PathMask {
+    /*
+     antialiased coverage of paths on the CPU, i.e. all points within halfWidth
+     from any polyline (so joins and caps are round), as what used to be drawn
+     with multisampling. coverage falls off linearly within half a pixel from
+     the edge. segments are put into square tiles, and each row of a tile only
+     visits the span that each segment of it covers. tiles run in parallel
+     */
+    class Rasterizer {
+    public:
+        Rasterizer(const int width, const int height, const int numThread = 1,
+                   const int tileSize = 64);
+        // coverage in [0, 255] of each pixel, written row by row to mask
+        void operator()(const std::vector<DistanceField::Polyline>& polylines,
+                        const float halfWidth, unsigned char* mask);
+    private:
+        struct Segment { float x, y, dx, dy, length; };
+        int imageWidth, imageHeight, numThread, tileSize, numTileX, numTileY;
+        std::vector<Segment> segments;
+        // segments overlapping tile i are tileSegments[tileBegin[i], tileBegin[i + 1])
+        std::vector<int> tileBegin, tileSegments;
+        void build(const std::vector<DistanceField::Polyline>& polylines, const float radius);
+        void drawTile(const int tileX, const int tileY, const float halfWidth,
+                      unsigned char* mask) const;
+    };
+}
+
+#endif /* pathmask_hpp */
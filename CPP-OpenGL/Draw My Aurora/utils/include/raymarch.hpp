@@ -0,0 +1,95 @@
+//
+//  raymarch.hpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#ifndef raymarch_hpp
+#define raymarch_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "distfield.hpp"
+
+/*
+ reference implementation of aurora.fs on the CPU, which needs no OpenGL, so
+ that frames can be rendered headless and measured without any driver. rays
+ are marched by the distance field only (as if every screen tile needs
+ marching and there were no spans, see SkyTiles and Ribbons), so samples may
+ be taken at other places than on the GPU, but the result should look the same
+ */
+namespace RayMarch {
+    /*
+     texels of a GL texture (or of each face of a cube map) in floats, as they
+     are after normalization and sRGB decoding, row 0 first as uploaded. it is
+     sampled as GL_LINEAR does
+     */
+    struct Texture {
+        int width, height, numLayer, numChannel;
+        bool isRepeated; // GL_REPEAT, otherwise GL_CLAMP_TO_EDGE
+        std::vector<float> texels;
+        Texture(): width(0), height(0), numLayer(0), numChannel(0), isRepeated(false) {}
+        Texture(const int width, const int height, const int numLayer, const int numChannel,
+                const bool isRepeated = false);
+        // isSRGB: decoded from sRGB (except alpha), as GL_SRGB textures are
+        static Texture fromBytes(const unsigned char* bytes, const int width, const int height,
+                                 const int numChannel, const bool isSRGB);
+        // like texelFetch() of GLSL
+        glm::vec4 fetch(const int x, const int y, const int layer = 0) const;
+        // like texture() of GLSL, where layer is already rounded
+        glm::vec4 sample(const glm::vec2& uv, const int layer = 0) const;
+    };
+
+    // what aurora.fs reads from textures and uniforms that do not change with view
+    struct Scene {
+        Texture deposition; // auroraDeposition
+        Texture airTrans; // airTransTable
+        Texture skybox[6]; // +X, -X, +Y, -Y, +Z, -Z, as loaded into a cube map
+        Texture paths; // auroraTexture, one layer per cascade
+        Texture distanceField; // atlas of safe steps in km, empty if there is only the pyramid
+        std::vector<Texture> pyramid; // fieldPyramid, one per level (numLayer is numCascade)
+        std::vector<int16_t> tiles; // fieldTiles, x and y of each tile of each cascade
+        int numTile; // of each cascade in each direction
+        glm::vec2 cascadeCenter;
+        float fieldSize, fieldTileSize, auroraLowHeight, auroraHighHeight;
+        Scene(): numTile(0), cascadeCenter(0.5f), fieldSize(0.0f), fieldTileSize(0.0f),
+                 auroraLowHeight(0.0f), auroraHighHeight(0.0f) {}
+        // fills airTrans with AirTrans::generate(), as Aurora does
+        void setAirTrans(const float sampleStep);
+    };
+
+    // uniforms of aurora.vs and aurora.fs that change with view
+    struct View {
+        glm::vec3 cameraPos, origin, xAxis, yAxis;
+    };
+
+    struct Stats {
+        double milliseconds;
+        int64_t numRay, numSample; // samples of curtains
+    };
+
+    /*
+     square tiles of the image are rendered by numThread threads. with AVX2 or
+     AVX-512, rays in a row of a tile are marched together in packets of 8 or
+     16, which gives the same image as marching them one by one. isa: throws
+     if it is not supported by the CPU
+     */
+    class Renderer {
+    public:
+        Renderer(const int numThread = 1, const int tileSize = 16,
+                 const DistanceField::Isa isa = DistanceField::bestIsa());
+        // image: width x height RGB bytes, the bottom row first (like glReadPixels)
+        Stats operator()(const Scene& scene, const View& view, const int width, const int height,
+                         unsigned char* image) const;
+    private:
+        int numThread, tileSize;
+        DistanceField::Isa isa;
+    };
+}
+
+#endif /* raymarch_hpp */
@@ -23,6 +23,8 @@ public:
     Shader(const std::string& vertexPath,
            const std::string& fragmentPath,
            const std::string& geometryPath = "");
+    // compute shader only (requires OpenGL 4.3)
+    explicit Shader(const std::string& computePath);
     void use() const;
     GLuint getUniform(const std::string& name) const;
     void setBool(const std::string& name, const bool value) const;
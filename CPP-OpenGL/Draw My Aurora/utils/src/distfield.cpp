@@ -8,110 +8,542 @@
 
 #include "distfield.hpp"
 
+#include <fcntl.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DISTFIELD_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 namespace DistanceField {
     static const Point inside  {     0,     0 };
-    static const Point outside { 16384, 16384 };
+    /*
+     outside pixels start far away, and get closer by one pixel along each axis
+     with each step of propagation, i.e. at most (size - 1). they should never
+     get closer than any inside pixel, while staying in int16 when one more
+     step is tried (hence size is at most outside / 2 + 1)
+     */
+    static const Point outside { 32766, 32766 };
+    static const int MIN_SEGMENT_WIDTH = 32;
+    static const int SPIN_COUNT = 64, YIELD_COUNT = 16; // checks of a counter before sleeping on it
+    static const int ROW_ALIGNMENT = 64; // in bytes, size of cache lines
+    static const int MAX_SSEDT_SIZE = outside.dx / 2 + 1;
+    static const int FAR_AWAY = 1 << 15; // farther than any pixel in the image
+    static const int BLOCK_SIZE = 4; // in pixels, used by SegmentField::measureTile()
+    static const int BLOCK_AREA = BLOCK_SIZE * BLOCK_SIZE;
+    
+    // splits tasks evenly among threads, and runs the first part on this thread
+    static void parallelFor(const int numThread, const int numTask,
+                            const std::function<void (int, int)>& taskFunc) {
+        std::vector<std::thread> threads;
+        for (int i = 1; i < numThread; ++i)
+            threads.emplace_back(taskFunc, numTask * i / numThread, numTask * (i + 1) / numThread);
+        taskFunc(0, numTask / numThread);
+        for (std::thread& thread : threads) thread.join();
+    }
+    
+    // working space of lowerEnvelope() for rows of at most length elements
+    struct Envelope {
+        std::vector<int> height, root;
+        std::vector<double> bound;
+        Envelope(const int length): height(length), root(length), bound(length + 1) {}
+    };
+    
+    /*
+     second pass of the separable transform: lower envelope of parabolas rooted
+     at each element (Felzenszwalb and Huttenlocher, "Distance Transforms of
+     Sampled Functions"). row holds distances along the other axis (FAR_AWAY if
+     none), and is replaced by squared distances. all values are integers below
+     2^31, and intersections are exact enough in double
+     */
+    static void lowerEnvelope(int* row, const int length, Envelope& envelope) {
+        int *height = envelope.height.data(), *root = envelope.root.data();
+        double *bound = envelope.bound.data();
+        int k = -1; // index of the rightmost parabola in the envelope
+        for (int q = 0; q < length; ++q) {
+            if (row[q] >= FAR_AWAY) continue; // nothing in this column
+            height[q] = row[q] * row[q];
+            double s = -std::numeric_limits<double>::infinity();
+            while (k >= 0) {
+                int p = root[k];
+                s = ((height[q] + (double)q * q) - (height[p] + (double)p * p)) / (2.0 * (q - p));
+                if (s > bound[k]) break;
+                --k;
+            }
+            if (k < 0) s = -std::numeric_limits<double>::infinity();
+            root[++k] = q;
+            bound[k] = s;
+            bound[k + 1] = std::numeric_limits<double>::infinity();
+        }
+        
+        if (k < 0) { // nothing in the whole row
+            std::fill(row, row + length, FAR_AWAY * FAR_AWAY);
+            return;
+        }
+        for (int x = 0, i = 0; x < length; ++x) {
+            while (bound[i + 1] < x) ++i;
+            int p = root[i];
+            row[x] = (x - p) * (x - p) + height[p];
+        }
+    }
+    
+    /*
+     sweep kernels: each pixel is compared with three candidates derived from
+     neighbours in the previous row, which do not depend on each other within a
+     row, so pixels can be processed in parallel. a candidate replaces the pixel
+     only if it is strictly closer, in the order of left, middle and right, so
+     all kernels produce exactly the same result. the kernels that need some
+     instruction set are compiled for it only, and chosen at runtime.
+     coordinates are int16 while squared distances are computed in int32
+     */
+    static void compareRowScalar(int16_t* rowX, int16_t* rowY, const int16_t* neighboursX,
+                                 const int16_t* neighboursY, const int begin, const int end,
+                                 const int dy) {
+        for (int x = begin; x < end; ++x) {
+            int bestX = rowX[x], bestY = rowY[x], bestDist = bestX * bestX + bestY * bestY;
+            for (int offset = -1; offset <= 1; ++offset) {
+                int otherX = neighboursX[x + offset] + offset, otherY = neighboursY[x + offset] + dy;
+                int dist = otherX * otherX + otherY * otherY;
+                if (dist < bestDist) {
+                    bestX = otherX;
+                    bestY = otherY;
+                    bestDist = dist;
+                }
+            }
+            rowX[x] = bestX;
+            rowY[x] = bestY;
+        }
+    }
+    
+#ifdef DISTFIELD_X86
+    // squared distances of the lower and higher half of points
+    __attribute__((target("sse4.1")))
+    static inline void distSqSSE41(const __m128i x, const __m128i y, __m128i& low, __m128i& high) {
+        __m128i xyLow = _mm_unpacklo_epi16(x, y), xyHigh = _mm_unpackhi_epi16(x, y);
+        low = _mm_madd_epi16(xyLow, xyLow);
+        high = _mm_madd_epi16(xyHigh, xyHigh);
+    }
+    
+    __attribute__((target("sse4.1")))
+    static void compareRowSSE41(int16_t* rowX, int16_t* rowY, const int16_t* neighboursX,
+                                const int16_t* neighboursY, const int begin, const int end,
+                                const int dy) {
+        const __m128i offsetY = _mm_set1_epi16(dy);
+        int x = begin;
+        for (; x + 8 <= end; x += 8) { // eight points at a time
+            __m128i bestX = _mm_loadu_si128((const __m128i *)(rowX + x));
+            __m128i bestY = _mm_loadu_si128((const __m128i *)(rowY + x));
+            __m128i bestLow, bestHigh;
+            distSqSSE41(bestX, bestY, bestLow, bestHigh);
+            for (int offset = -1; offset <= 1; ++offset) {
+                __m128i otherX = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(neighboursX + x + offset)),
+                                               _mm_set1_epi16(offset));
+                __m128i otherY = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(neighboursY + x + offset)),
+                                               offsetY);
+                __m128i otherLow, otherHigh;
+                distSqSSE41(otherX, otherY, otherLow, otherHigh);
+                __m128i closer = _mm_packs_epi32(_mm_cmplt_epi32(otherLow, bestLow),
+                                                 _mm_cmplt_epi32(otherHigh, bestHigh));
+                bestX = _mm_blendv_epi8(bestX, otherX, closer);
+                bestY = _mm_blendv_epi8(bestY, otherY, closer);
+                bestLow = _mm_min_epi32(bestLow, otherLow);
+                bestHigh = _mm_min_epi32(bestHigh, otherHigh);
+            }
+            _mm_storeu_si128((__m128i *)(rowX + x), bestX);
+            _mm_storeu_si128((__m128i *)(rowY + x), bestY);
+        }
+        compareRowScalar(rowX, rowY, neighboursX, neighboursY, x, end, dy);
+    }
+    
+    // unpacking and packing work within 128-bit lanes, so the order is kept
+    __attribute__((target("avx2")))
+    static inline void distSqAVX2(const __m256i x, const __m256i y, __m256i& low, __m256i& high) {
+        __m256i xyLow = _mm256_unpacklo_epi16(x, y), xyHigh = _mm256_unpackhi_epi16(x, y);
+        low = _mm256_madd_epi16(xyLow, xyLow);
+        high = _mm256_madd_epi16(xyHigh, xyHigh);
+    }
+    
+    __attribute__((target("avx2")))
+    static void compareRowAVX2(int16_t* rowX, int16_t* rowY, const int16_t* neighboursX,
+                               const int16_t* neighboursY, const int begin, const int end,
+                               const int dy) {
+        const __m256i offsetY = _mm256_set1_epi16(dy);
+        int x = begin;
+        for (; x + 16 <= end; x += 16) { // sixteen points at a time
+            __m256i bestX = _mm256_loadu_si256((const __m256i *)(rowX + x));
+            __m256i bestY = _mm256_loadu_si256((const __m256i *)(rowY + x));
+            __m256i bestLow, bestHigh;
+            distSqAVX2(bestX, bestY, bestLow, bestHigh);
+            for (int offset = -1; offset <= 1; ++offset) {
+                __m256i otherX = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(neighboursX + x + offset)),
+                                                  _mm256_set1_epi16(offset));
+                __m256i otherY = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(neighboursY + x + offset)),
+                                                  offsetY);
+                __m256i otherLow, otherHigh;
+                distSqAVX2(otherX, otherY, otherLow, otherHigh);
+                __m256i closer = _mm256_packs_epi32(_mm256_cmpgt_epi32(bestLow, otherLow),
+                                                    _mm256_cmpgt_epi32(bestHigh, otherHigh));
+                bestX = _mm256_blendv_epi8(bestX, otherX, closer);
+                bestY = _mm256_blendv_epi8(bestY, otherY, closer);
+                bestLow = _mm256_min_epi32(bestLow, otherLow);
+                bestHigh = _mm256_min_epi32(bestHigh, otherHigh);
+            }
+            _mm256_storeu_si256((__m256i *)(rowX + x), bestX);
+            _mm256_storeu_si256((__m256i *)(rowY + x), bestY);
+        }
+        compareRowScalar(rowX, rowY, neighboursX, neighboursY, x, end, dy);
+    }
+    
+    __attribute__((target("avx512f,avx512bw")))
+    static inline void distSqAVX512(const __m512i x, const __m512i y, __m512i& low, __m512i& high) {
+        __m512i xyLow = _mm512_unpacklo_epi16(x, y), xyHigh = _mm512_unpackhi_epi16(x, y);
+        low = _mm512_madd_epi16(xyLow, xyLow);
+        high = _mm512_madd_epi16(xyHigh, xyHigh);
+    }
+    
+    __attribute__((target("avx512f,avx512bw")))
+    static void compareRowAVX512(int16_t* rowX, int16_t* rowY, const int16_t* neighboursX,
+                                 const int16_t* neighboursY, const int begin, const int end,
+                                 const int dy) {
+        const __m512i offsetY = _mm512_set1_epi16(dy), allSet = _mm512_set1_epi32(-1);
+        int x = begin;
+        for (; x + 32 <= end; x += 32) { // thirty-two points at a time
+            __m512i bestX = _mm512_loadu_si512(rowX + x);
+            __m512i bestY = _mm512_loadu_si512(rowY + x);
+            __m512i bestLow, bestHigh;
+            distSqAVX512(bestX, bestY, bestLow, bestHigh);
+            for (int offset = -1; offset <= 1; ++offset) {
+                __m512i otherX = _mm512_add_epi16(_mm512_loadu_si512(neighboursX + x + offset),
+                                                  _mm512_set1_epi16(offset));
+                __m512i otherY = _mm512_add_epi16(_mm512_loadu_si512(neighboursY + x + offset), offsetY);
+                __m512i otherLow, otherHigh;
+                distSqAVX512(otherX, otherY, otherLow, otherHigh);
+                // masks of int32 are packed in the same way as squared distances
+                __m512i closerLow = _mm512_maskz_mov_epi32(_mm512_cmplt_epi32_mask(otherLow, bestLow), allSet);
+                __m512i closerHigh = _mm512_maskz_mov_epi32(_mm512_cmplt_epi32_mask(otherHigh, bestHigh), allSet);
+                __mmask32 closer = _mm512_movepi16_mask(_mm512_packs_epi32(closerLow, closerHigh));
+                bestX = _mm512_mask_blend_epi16(closer, bestX, otherX);
+                bestY = _mm512_mask_blend_epi16(closer, bestY, otherY);
+                bestLow = _mm512_min_epi32(bestLow, otherLow);
+                bestHigh = _mm512_min_epi32(bestHigh, otherHigh);
+            }
+            _mm512_storeu_si512(rowX + x, bestX);
+            _mm512_storeu_si512(rowY + x, bestY);
+        }
+        compareRowScalar(rowX, rowY, neighboursX, neighboursY, x, end, dy);
+    }
     
-    Generator::Generator(const int width, const int height):
+    static inline uint64_t readXCR0() {
+        uint32_t eax, edx;
+        __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((uint64_t)edx << 32) | eax;
+    }
+#endif
+    
+    static Isa detectIsa() {
+#ifdef DISTFIELD_X86
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) return Isa::Scalar;
+        
+        // wider registers should also be saved by the OS on context switches
+        if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return Isa::SSE41;
+        uint64_t xcr0 = readXCR0();
+        if ((xcr0 & 0x6) != 0x6) return Isa::SSE41; // XMM and YMM
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2)) return Isa::SSE41;
+        
+        // note that macOS enables AVX-512 states lazily, so AVX2 will be used there
+        if (!(ebx & bit_AVX512F) || !(ebx & bit_AVX512BW) || (xcr0 & 0xe0) != 0xe0)
+            return Isa::AVX2; // opmask and ZMM
+        return Isa::AVX512;
+#else
+        return Isa::Scalar;
+#endif
+    }
+    
+    Isa bestIsa() {
+        static const Isa isa = detectIsa();
+        return isa;
+    }
+    
+    static auto selectKernel(const Isa isa) -> decltype(&compareRowScalar) {
+        if (isa > bestIsa()) throw std::runtime_error("Instruction set not supported by CPU");
+        switch (isa) {
+#ifdef DISTFIELD_X86
+            case Isa::SSE41: return compareRowSSE41;
+            case Isa::AVX2: return compareRowAVX2;
+            case Isa::AVX512: return compareRowAVX512;
+#endif
+            default: return compareRowScalar;
+        }
+    }
+    
+    Generator::Generator(const int width, const int height, const int numThread,
+                         const Engine engine, const Isa isa):
     imageWidth(width),
     imageHeight(height),
-    gridWidth(width + 2),
+    gridWidth((width + 2 + ROW_ALIGNMENT / 2 - 1) / (ROW_ALIGNMENT / 2) * (ROW_ALIGNMENT / 2)),
     gridHeight(height + 2),
     numPoint(gridWidth * gridHeight), // include padding
-    grid((Point *)malloc(numPoint * sizeof(Point))) {}
-    
-    void Generator::operator()(unsigned char* image) {
-        // initialize distance field
-        for (int y = 0; y < imageHeight; ++y) {
-            for (int x = 0; x < imageWidth; ++x) {
-                if (image[y * imageWidth + x] < 128) {
-                    put(x, y, outside);
-                } else {
-                    put(x, y, inside);
-                }
+    numThread(std::max(1, std::min(numThread, width / MIN_SEGMENT_WIDTH))),
+    engine(engine),
+    compareRow(selectKernel(isa)),
+    gridX(nullptr),
+    gridY(nullptr),
+    distSq(engine == Engine::Exact ? (int *)malloc(width * height * sizeof(int)) : nullptr),
+    segments(this->numThread) {
+        if (engine == Engine::SSEDT) {
+            if (width > MAX_SSEDT_SIZE || height > MAX_SSEDT_SIZE)
+                throw std::runtime_error("Image too large for SSEDT");
+            void *dx = nullptr, *dy = nullptr;
+            if (posix_memalign(&dx, ROW_ALIGNMENT, numPoint * sizeof(int16_t)) ||
+                posix_memalign(&dy, ROW_ALIGNMENT, numPoint * sizeof(int16_t))) {
+                free(dx);
+                throw std::runtime_error("Failed to allocate grid");
             }
+            gridX = (int16_t *)dx;
+            gridY = (int16_t *)dy;
         }
-        for (int x = 0; x < imageWidth; ++x) { // top and buttom padding
-            put(x, -1, get(x, 0));
-            put(x, imageHeight, get(x, imageHeight - 1));
+        for (int i = 0; i < this->numThread; ++i) {
+            segments[i].begin = imageWidth * i / this->numThread;
+            segments[i].end = imageWidth * (i + 1) / this->numThread;
         }
-        for (int y = -1; y <= imageHeight; ++y) { // left and right padding
-            put(-1, y, get(0, y));
-            put(imageWidth, y, get(imageWidth - 1, y));
+    }
+    
+    // magnitude is rounded down, and saturates at the range of int16
+    static inline void encode(const float value, int16_t& out) {
+        out = (int16_t)std::max(-32768.0f, std::min(value * INT16_SUBPIXEL, 32767.0f));
+    }
+    
+    static inline float decode(const int16_t value) {
+        return (float)value / INT16_SUBPIXEL;
+    }
+    
+    static inline void encodeGradient(const float value, int16_t& out) {
+        out = (int16_t)std::max(-32767.0f, std::min(value * 32767.0f, 32767.0f));
+    }
+    
+    void encode(const float value, Half& out) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint16_t sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+        if (exponent >= 31) { // too large
+            out.bits = sign | 0x7bff;
+        } else if (exponent <= 0) { // subnormal or zero
+            out.bits = exponent < -10 ? sign : sign | ((mantissa | 0x800000) >> (14 - exponent));
+        } else {
+            out.bits = sign | (exponent << 10) | (mantissa >> 13);
         }
-        
-        // calculate
-        generateSDF();
+    }
+    
+    float decode(const Half value) {
+        int exponent = (value.bits >> 10) & 0x1f, mantissa = value.bits & 0x3ff;
+        float magnitude = exponent == 0 ? ldexpf(mantissa, -24) : ldexpf(mantissa | 0x400, exponent - 25);
+        return value.bits & 0x8000 ? -magnitude : magnitude;
+    }
+    
+    static inline void encodeGradient(const float value, Half& out) {
+        encode(value, out);
+    }
+    
+    // expand rect by margin on each side, and clip it to the image
+    static inline Rect expand(const Rect& rect, const int margin, const int width, const int height) {
+        int x0 = std::max(rect.x - margin, 0), y0 = std::max(rect.y - margin, 0);
+        int x1 = std::min(rect.x + rect.width + margin, width);
+        int y1 = std::min(rect.y + rect.height + margin, height);
+        return { x0, y0, x1 - x0, y1 - y0 };
+    }
+    
+    // (255 - distance) of each squared distance below 256 * 256 (others are 0)
+    static const std::vector<unsigned char>& byteTable() {
+        static const std::vector<unsigned char> table = [] {
+            std::vector<unsigned char> table(256 * 256);
+            for (int i = 0; i < 256 * 256; ++i)
+                table[i] = 255 - (int)sqrt((double)i);
+            return table;
+        }();
+        return table;
+    }
+    
+    void Generator::operator()(unsigned char* image) {
+        resetPasses();
+        transform(image, false, { 0, 0, imageWidth, imageHeight });
         
         // write data back to image
-        for(int y = 0; y < imageHeight; ++y) {
-            for (int x = 0 ; x < imageWidth; ++x) {
-                int dist = (int)(sqrt((double)get(x, y).distSq()));
-                int c = dist;
-                if (c < 0) c = 0;
-                else if (c > 255) c = 255;
-                image[y * imageWidth + x] = 255 - c;
+        const std::vector<unsigned char>& table = byteTable();
+        runInParallel(imageHeight, [&] (const int yBegin, const int yEnd) {
+            for(int y = yBegin; y < yEnd; ++y) {
+                for (int x = 0 ; x < imageWidth; ++x) {
+                    unsigned sq = getDistSq(x, y);
+                    image[y * imageWidth + x] = sq < table.size() ? table[sq] : 0;
+                }
             }
-        }
+        });
+        finishPass("write");
+    }
+    
+    void Generator::operator()(const unsigned char* mask, int16_t* field, int16_t* gradient) {
+        generateSigned(mask, field, gradient, { 0, 0, imageWidth, imageHeight },
+                       std::numeric_limits<float>::infinity());
+    }
+    
+    void Generator::operator()(const unsigned char* mask, Half* field, Half* gradient) {
+        generateSigned(mask, field, gradient, { 0, 0, imageWidth, imageHeight },
+                       std::numeric_limits<float>::infinity());
+    }
+    
+    void Generator::update(const unsigned char* mask, const Rect& dirty, const float maxDistance,
+                           int16_t* field, int16_t* gradient) {
+        generateSigned(mask, field, gradient, dirty, maxDistance);
+    }
+    
+    void Generator::update(const unsigned char* mask, const Rect& dirty, const float maxDistance,
+                           Half* field, Half* gradient) {
+        generateSigned(mask, field, gradient, dirty, maxDistance);
+    }
+    
+    const std::vector<Generator::Pass>& Generator::getPasses() const {
+        return passes;
     }
     
     Generator::~Generator() {
-        free(grid);
+        free(gridX);
+        free(gridY);
+        free(distSq);
     }
     
     inline Point Generator::get(const int x, const int y) {
-        return grid[(y + 1) * gridWidth + (x + 1)];
+        int index = (y + 1) * gridWidth + (x + 1);
+        return { gridX[index], gridY[index] };
     }
     
     inline void Generator::put(const int x, const int y, const Point &p) {
-        grid[(y + 1) * gridWidth + (x + 1)] = p;
+        int index = (y + 1) * gridWidth + (x + 1);
+        gridX[index] = p.dx;
+        gridY[index] = p.dy;
     }
     
-    inline Point Generator::groupCompare(Point other, const int x, const int y,
-                                         const __m256i& offsets) {
-        Point self = get(x, y);
+    inline int Generator::getDistSq(const int x, const int y) {
+        return engine == Engine::Exact ? distSq[y * imageWidth + x] : get(x, y).distSq();
+    }
+    
+    // distance to the closest inside pixel (or outside pixel if inverted),
+    // only considering pixels in window
+    void Generator::transform(const unsigned char* image, const bool inverted, const Rect& window) {
+        if (engine == Engine::Exact) {
+            generateEDT(image, inverted, window);
+            return;
+        }
         
-        /* Point other = Get( g, x+offsetx, y+offsety ); */
-        int *offsetsPtr = (int *)&offsets;
-        Point pn[4] = {
-            other,
-            get(x + offsetsPtr[1], y + offsetsPtr[5]),
-            get(x + offsetsPtr[2], y + offsetsPtr[6]),
-            get(x + offsetsPtr[3], y + offsetsPtr[7]),
-        };
+        // initialize distance field
+        const int x0 = window.x, x1 = window.x + window.width;
+        const int y0 = window.y, y1 = window.y + window.height;
+        runInParallel(window.height, [&] (const int yBegin, const int yEnd) {
+            for (int y = y0 + yBegin; y < y0 + yEnd; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    if ((image[y * imageWidth + x] < 128) != inverted) {
+                        put(x, y, outside);
+                    } else {
+                        put(x, y, inside);
+                    }
+                }
+            }
+        });
+        // padding around the window (may overwrite pixels out of it)
+        for (int x = x0; x < x1; ++x) { // top and buttom padding
+            put(x, y0 - 1, get(x, y0));
+            put(x, y1, get(x, y1 - 1));
+        }
+        for (int y = y0 - 1; y <= y1; ++y) { // left and right padding
+            put(x0 - 1, y, get(x0, y));
+            put(x1, y, get(x1 - 1, y));
+        }
+        finishPass("init");
         
-        /* other.dx += offsetx; other.dy += offsety; */
-        __m256i *pnPtr = (__m256i *)pn;
-        // x0, y0, x1, y1, x2, y2, x3, y3 -> x0, x1, x2, x3, y0, y1, y2, y3
-        static const __m256i mask = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
-        __m256i vecCoords = _mm256_permutevar8x32_epi32(*pnPtr, mask);
-        vecCoords = _mm256_add_epi32(vecCoords, offsets);
-        
-        /* other.DistSq() */
-        int *coordsPtr = (int *)&vecCoords;
-        // note that _mm256_mul_epi32 only applies on the lower 128 bits
-        __m256i vecPermuted = _mm256_permute2x128_si256(vecCoords , vecCoords, 1);
-        __m256i vecSqrDists = _mm256_add_epi64(_mm256_mul_epi32(vecCoords, vecCoords),
-                                               _mm256_mul_epi32(vecPermuted, vecPermuted));
-        
-        /* if (other.DistSq() < p.DistSq()) p = other; */
-        int64_t prevDist = self.distSq(), index = -1;
-        for (int i = 0; i < 4; ++i) {
-            int64_t dist = *((int64_t *)&vecSqrDists + i);
-            if (dist < prevDist) {
-                prevDist = dist;
-                index = i;
-            }
-        }
-        if (index != -1) {
-            other = { coordsPtr[index], coordsPtr[index + 4] };
-            put(x, y, other);
-            return other;
+        // calculate (segments of wavefront always span the whole image)
+        if (numThread == 1 || window.width != imageWidth || window.height != imageHeight) {
+            generateSDF(window);
         } else {
-            return self;
+            for (Segment& segment : segments) {
+                segment.numChained.store(0);
+                segment.numFinished.store(0);
+                segment.numWaiting.store(0);
+            }
+            std::vector<std::thread> threads;
+            for (int i = 1; i < numThread; ++i)
+                threads.emplace_back([=] { generateSDF(i); });
+            generateSDF(0);
+            for (std::thread& thread : threads) thread.join();
+        }
+        finishPass("sweep");
+    }
+    
+    /*
+     the boundary lies halfway between an inside pixel and its closest outside
+     pixel, so both transforms are offset by half a pixel. the field is then
+     continuous across the boundary, instead of jumping from +1 to -1.
+     when distances are clamped to maxDistance, a change of mask can only affect
+     pixels (region) within that radius from dirty, and their closest pixels
+     across the boundary are again within that radius (window)
+     */
+    template <typename T>
+    void Generator::generateSigned(const unsigned char* mask, T* field, T* gradient,
+                                   const Rect& dirty, const float maxDistance) {
+        resetPasses();
+        Rect region = expand(dirty, 0, imageWidth, imageHeight), window = region;
+        if (maxDistance < std::numeric_limits<float>::infinity()) {
+            int radius = (int)ceil(maxDistance) + 1;
+            region = expand(region, radius, imageWidth, imageHeight);
+            window = expand(region, radius, imageWidth, imageHeight);
+        }
+        if (region.width <= 0 || region.height <= 0) return;
+        
+        for (const bool inverted : { false, true }) {
+            transform(mask, inverted, window);
+            runInParallel(region.height, [&] (const int yBegin, const int yEnd) {
+                for (int y = region.y + yBegin; y < region.y + yEnd; ++y) {
+                    for (int x = region.x; x < region.x + region.width; ++x) {
+                        int i = y * imageWidth + x;
+                        if ((mask[i] < 128) == inverted) continue; // written by the other pass
+                        float dist = std::min(sqrt((float)getDistSq(x, y)) - 0.5f, maxDistance);
+                        encode(inverted ? -dist : dist, field[i]);
+                    }
+                }
+            });
+            finishPass("write");
         }
+        if (!gradient) return;
+        
+        // central differences (one-sided on borders)
+        region = expand(region, 1, imageWidth, imageHeight);
+        runInParallel(region.height, [&] (const int yBegin, const int yEnd) {
+            for (int y = region.y + yBegin; y < region.y + yEnd; ++y) {
+                int up = std::max(y - 1, 0), down = std::min(y + 1, imageHeight - 1);
+                for (int x = region.x; x < region.x + region.width; ++x) {
+                    int left = std::max(x - 1, 0), right = std::min(x + 1, imageWidth - 1);
+                    float gradx = (decode(field[y * imageWidth + right]) -
+                                   decode(field[y * imageWidth + left])) / (right - left);
+                    float grady = (decode(field[down * imageWidth + x]) -
+                                   decode(field[up * imageWidth + x])) / (down - up);
+                    encodeGradient(gradx, gradient[(y * imageWidth + x) * 2]);
+                    encodeGradient(grady, gradient[(y * imageWidth + x) * 2 + 1]);
+                }
+            }
+        });
+        finishPass("gradient");
     }
     
     inline Point Generator::singleCompare(Point other, const int x, const int y,
@@ -128,29 +560,846 @@ namespace DistanceField {
         }
     }
     
-    void Generator::generateSDF() {
+    void Generator::generateSDF(const Rect& window) {
+        const int x0 = window.x, x1 = window.x + window.width;
+        const int y0 = window.y, y1 = window.y + window.height;
+        
         // Pass 0
-        static const __m256i offsets0 = _mm256_setr_epi32(-1, -1, 0, 1, 0, -1, -1, -1);
-        for (int y = 0; y < imageHeight; ++y) {
-            Point prev = get(-1, y);
-            for (int x = 0; x < imageWidth; ++x)
-                prev = groupCompare(prev, x, y, offsets0);
+        for (int y = y0; y < y1; ++y) {
+            int row = (y + 1) * gridWidth + 1;
+            compareRow(gridX + row, gridY + row, gridX + row - gridWidth, gridY + row - gridWidth, x0, x1, -1);
             
-            prev = get(imageWidth, y);
-            for (int x = imageWidth - 1; x >= 0; --x)
+            Point prev = get(x0 - 1, y);
+            for (int x = x0; x < x1; ++x)
+                prev = singleCompare(prev, x, y, -1, 0);
+            
+            prev = get(x1, y);
+            for (int x = x1 - 1; x >= x0; --x)
                 prev = singleCompare(prev, x, y, 1, 0);
         }
         
         // Pass 1
-        static const __m256i offsets1 = _mm256_setr_epi32(1, -1, 0, 1, 0, 1, 1, 1);
-        for (int y = imageHeight - 1; y >= 0; --y) {
-            Point prev = get(imageWidth, y);
-            for (int x = imageWidth - 1; x >= 0; --x)
-                prev = groupCompare(prev, x, y, offsets1);
+        for (int y = y1 - 1; y >= y0; --y) {
+            int row = (y + 1) * gridWidth + 1;
+            compareRow(gridX + row, gridY + row, gridX + row + gridWidth, gridY + row + gridWidth, x0, x1, 1);
+            
+            Point prev = get(x1, y);
+            for (int x = x1 - 1; x >= x0; --x)
+                prev = singleCompare(prev, x, y, 1, 0);
             
-            prev = get(-1, y);
-            for (int x = 0; x < imageWidth; ++x)
+            prev = get(x0 - 1, y);
+            for (int x = x0; x < x1; ++x)
                 prev = singleCompare(prev, x, y, -1, 0);
         }
     }
+    
+    void Generator::generateSDF(const int index) {
+        // the same two passes as above, but only sweep pixels of one segment
+        Segment& self = segments[index];
+        Segment *left = index > 0 ? &segments[index - 1] : nullptr;
+        Segment *right = index < numThread - 1 ? &segments[index + 1] : nullptr;
+        std::vector<Point> saved(self.end - self.begin);
+        
+        // the neighbour is usually about to get there, so it spins and then yields
+        // for a while before sleeping (yielding is enough when threads outnumber
+        // cores). it only locks when someone may be sleeping
+        auto waitFor = [] (Segment& segment, const std::atomic<int>& counter, const int value) {
+            for (int i = 0; i < SPIN_COUNT; ++i)
+                if (counter.load(std::memory_order_acquire) >= value) return;
+            for (int i = 0; i < YIELD_COUNT; ++i) {
+                if (counter.load(std::memory_order_acquire) >= value) return;
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock(segment.mutex);
+            segment.numWaiting.fetch_add(1);
+            segment.counted.wait(lock, [&] { return counter.load() >= value; });
+            segment.numWaiting.fetch_sub(1);
+        };
+        auto publish = [&] (std::atomic<int>& counter, const int value) {
+            counter.store(value);
+            if (self.numWaiting.load() > 0) {
+                { std::lock_guard<std::mutex> lock(self.mutex); }
+                self.counted.notify_all();
+            }
+        };
+        
+        for (int step = 0; step < imageHeight * 2; ++step) {
+            // pass 0 goes down and chains left to right first, pass 1 is the opposite
+            bool isPass0 = step < imageHeight;
+            int y = isPass0 ? step : imageHeight * 2 - 1 - step;
+            int dir = isPass0 ? 1 : -1;
+            int first = isPass0 ? self.begin : self.end - 1;
+            int last = isPass0 ? self.end - 1 : self.begin;
+            Segment *upstream = isPass0 ? left : right;
+            Segment *downstream = isPass0 ? right : left;
+            
+            // compare with three neighbours in the previous row. downstream finished
+            // it before this segment did, but upstream may not have yet, so the head
+            // is compared once the carry from there comes, which comes after that
+            int row = (y + 1) * gridWidth + 1, neighbours = row - gridWidth * dir;
+            int begin = upstream && isPass0 ? self.begin + 1 : self.begin;
+            int end = upstream && !isPass0 ? self.end - 1 : self.end;
+            compareRow(gridX + row, gridY + row, gridX + neighbours, gridY + neighbours, begin, end, -dir);
+            
+            // first chain, comparing with one neighbour. if the carry is not known yet,
+            // start with a point that is never closer than the head itself
+            for (int x = self.begin; x < self.end; ++x)
+                saved[x - self.begin] = get(x, y);
+            Point head = get(first, y);
+            Point prev = upstream ? Point { head.dx + dir, head.dy } : get(first - dir, y);
+            for (int x = first; x != last + dir; x += dir)
+                prev = singleCompare(prev, x, y, -dir, 0);
+            
+            // redo the head with the real carry, until the result agrees with the local one
+            if (upstream) {
+                waitFor(*upstream, upstream->numChained, step + 1);
+                compareRow(gridX + row, gridY + row, gridX + neighbours, gridY + neighbours,
+                           first, first + 1, -dir);
+                saved[first - self.begin] = get(first, y);
+                put(first, y, head); // as the local chain left it
+                prev = upstream->firstCarry;
+                for (int x = first; x != last + dir; x += dir) {
+                    Point local = get(x, y);
+                    put(x, y, saved[x - self.begin]);
+                    prev = singleCompare(prev, x, y, -dir, 0);
+                    if (prev == local) break;
+                }
+            }
+            self.firstCarry = get(last, y);
+            publish(self.numChained, step + 1);
+            
+            // second chain, comparing with one neighbour in the opposite direction
+            for (int x = self.begin; x < self.end; ++x)
+                saved[x - self.begin] = get(x, y);
+            Point tail = get(last, y);
+            prev = downstream ? Point { tail.dx - dir, tail.dy } : get(last + dir, y);
+            for (int x = last; x != first - dir; x -= dir)
+                prev = singleCompare(prev, x, y, dir, 0);
+            
+            if (downstream) {
+                waitFor(*downstream, downstream->numFinished, step + 1);
+                prev = downstream->secondCarry;
+                for (int x = last; x != first - dir; x -= dir) {
+                    Point local = get(x, y);
+                    put(x, y, saved[x - self.begin]);
+                    prev = singleCompare(prev, x, y, dir, 0);
+                    if (prev == local) break;
+                }
+            }
+            self.secondCarry = get(first, y);
+            publish(self.numFinished, step + 1);
+        }
+    }
+    
+    void Generator::generateEDT(const unsigned char* image, const bool inverted, const Rect& window) {
+        // if inverted, measure distance from inside pixels to the closest outside pixel
+        auto isOutside = [=] (const unsigned char pixel) { return (pixel < 128) != inverted; };
+        const int x0 = window.x;
+        const int y0 = window.y, y1 = window.y + window.height;
+        
+        // pass 0: distance to the closest inside pixel in the same column
+        // columns are visited together row by row to keep memory access linear
+        runInParallel(window.width, [&] (const int xBegin, const int xEnd) {
+            int *firstRow = distSq + y0 * imageWidth;
+            const unsigned char *firstPixels = image + y0 * imageWidth;
+            for (int x = x0 + xBegin; x < x0 + xEnd; ++x)
+                firstRow[x] = isOutside(firstPixels[x]) ? FAR_AWAY : 0;
+            for (int y = y0 + 1; y < y1; ++y) {
+                int *row = distSq + y * imageWidth, *prevRow = row - imageWidth;
+                const unsigned char *pixels = image + y * imageWidth;
+                for (int x = x0 + xBegin; x < x0 + xEnd; ++x)
+                    row[x] = isOutside(pixels[x]) ? std::min(prevRow[x] + 1, FAR_AWAY) : 0;
+            }
+            for (int y = y1 - 2; y >= y0; --y) {
+                int *row = distSq + y * imageWidth, *nextRow = row + imageWidth;
+                for (int x = x0 + xBegin; x < x0 + xEnd; ++x)
+                    row[x] = std::min(row[x], nextRow[x] + 1);
+            }
+        });
+        finishPass("columns");
+        
+        // pass 1: lower envelope along rows
+        runInParallel(window.height, [&] (const int yBegin, const int yEnd) {
+            Envelope envelope(window.width);
+            for (int y = y0 + yBegin; y < y0 + yEnd; ++y)
+                lowerEnvelope(distSq + y * imageWidth + x0, window.width, envelope);
+        });
+        finishPass("rows");
+    }
+    
+    void Generator::runInParallel(const int numTask, const std::function<void (int, int)>& taskFunc) {
+        parallelFor(numThread, numTask, taskFunc);
+    }
+    
+    void Generator::resetPasses() {
+        passes.clear();
+        passStart = std::chrono::steady_clock::now();
+    }
+    
+    void Generator::finishPass(const char* name) {
+        auto now = std::chrono::steady_clock::now();
+        passes.push_back({ name, std::chrono::duration<double, std::milli>(now - passStart).count() });
+        passStart = now;
+    }
+    
+    // [offset, offset + size) of file mapped into memory, which may start anywhere in a page
+    struct Mapping {
+        void* base;
+        size_t length;
+        char* data;
+        Mapping(const int file, const size_t offset, const size_t size, const bool writable) {
+            static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+            size_t begin = offset / pageSize * pageSize;
+            length = offset + size - begin;
+            base = mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                        MAP_SHARED, file, (off_t)begin);
+            if (base == MAP_FAILED) throw std::runtime_error("Failed to map scratch file");
+            data = (char *)base + (offset - begin);
+        }
+        ~Mapping() { munmap(base, length); }
+    };
+    
+    // chains comparisons along a padded row, from left to right if step is 1,
+    // or from right to left if step is -1 (the same as Generator::singleCompare())
+    static void chainRow(int16_t* rowX, int16_t* rowY, const int width, const int step) {
+        int begin = step > 0 ? 1 : width, end = step > 0 ? width + 1 : 0;
+        int prevX = rowX[begin - step], prevY = rowY[begin - step];
+        for (int x = begin; x != end; x += step) {
+            int otherX = prevX - step, otherY = prevY;
+            if (otherX * otherX + otherY * otherY < rowX[x] * rowX[x] + rowY[x] * rowY[x]) {
+                rowX[x] = otherX;
+                rowY[x] = otherY;
+            }
+            prevX = rowX[x];
+            prevY = rowY[x];
+        }
+    }
+    
+    // the same as Generator::operator()(unsigned char*)
+    static inline void writeStrip(const int outsideSq, const int, unsigned char& out) {
+        const std::vector<unsigned char>& table = byteTable();
+        out = (unsigned)outsideSq < table.size() ? table[outsideSq] : 0;
+    }
+    
+    // the same as Generator::generateSigned() (only inside pixels are at zero from inside)
+    template <typename T>
+    static inline void writeStrip(const int outsideSq, const int insideSq, T& out) {
+        if (outsideSq == 0) encode(-(sqrt((float)insideSq) - 0.5f), out);
+        else encode(sqrt((float)outsideSq) - 0.5f, out);
+    }
+    
+    StripGenerator::StripGenerator(const int width, const int height, const size_t stripBudget,
+                                   const std::string& scratchPath, const Isa isa):
+    imageWidth(width),
+    imageHeight(height),
+    rowWidth((width + 2 + ROW_ALIGNMENT / 2 - 1) / (ROW_ALIGNMENT / 2) * (ROW_ALIGNMENT / 2)),
+    stripBudget(stripBudget),
+    compareRow(selectKernel(isa)),
+    rows(nullptr) {
+        if (width > MAX_SSEDT_SIZE || height > MAX_SSEDT_SIZE)
+            throw std::runtime_error("Image too large for SSEDT");
+        // 3 slots * 2 channels * 2 axes
+        void *buffer = nullptr;
+        if (posix_memalign(&buffer, ROW_ALIGNMENT, rowWidth * 12 * sizeof(int16_t)))
+            throw std::runtime_error("Failed to allocate rows");
+        rows = (int16_t *)buffer;
+        
+        scratchFile = open(scratchPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (scratchFile < 0) {
+            free(rows);
+            throw std::runtime_error("Failed to open scratch file " + scratchPath);
+        }
+        unlink(scratchPath.c_str()); // freed once closed
+    }
+    
+    void StripGenerator::operator()(const Strip<unsigned char>& read, const Strip<const unsigned char>& write) {
+        generate(read, write);
+    }
+    
+    void StripGenerator::operator()(const Strip<unsigned char>& read, const Strip<const int16_t>& write) {
+        generate(read, write);
+    }
+    
+    void StripGenerator::operator()(const Strip<unsigned char>& read, const Strip<const Half>& write) {
+        generate(read, write);
+    }
+    
+    StripGenerator::~StripGenerator() {
+        close(scratchFile);
+        free(rows);
+    }
+    
+    inline int16_t* StripGenerator::getRow(const int slot, const int channel, const int axis) {
+        return rows + ((slot * 2 + channel) * 2 + axis) * rowWidth;
+    }
+    
+    /*
+     each row is initialized and swept by pass 0 right after it is read, so
+     only the previous row is kept in memory, and padding is the same as the
+     grid of Generator has (init of the first or last row, or of the pixel
+     next to it). padding is never changed by sweeps, so rows are stored in
+     the scratch file with it, and pass 1 can find it there
+     */
+    template <typename T>
+    void StripGenerator::generate(const Strip<unsigned char>& read, const Strip<const T>& write) {
+        const int numChannel = std::is_same<T, unsigned char>::value ? 1 : 2;
+        const int paddedWidth = imageWidth + 2;
+        const size_t rowBytes = numChannel * 2 * paddedWidth * sizeof(int16_t);
+        const size_t stripRowBytes = rowBytes + imageWidth * (sizeof(unsigned char) + sizeof(T));
+        const int numStripRow = (int)std::max(std::min(stripBudget / stripRowBytes, (size_t)imageHeight),
+                                              (size_t)1);
+        std::vector<unsigned char> mask(numStripRow * imageWidth);
+        std::vector<T> output(numStripRow * imageWidth);
+        if (ftruncate(scratchFile, (off_t)(rowBytes * imageHeight)))
+            throw std::runtime_error("Failed to resize scratch file");
+        
+        int prev = 0, curr = 1;
+        const int last = 2;
+        auto copySlot = [&] (const int from, const int to) {
+            memcpy(getRow(to, 0, 0), getRow(from, 0, 0), rowWidth * 4 * sizeof(int16_t));
+        };
+        // pass 0 compares with the row above, and chains left to right first
+        // pass 1 compares with the row below, and chains right to left first
+        auto sweep = [&] (const int dy) {
+            for (int channel = 0; channel < numChannel; ++channel) {
+                int16_t *rowX = getRow(curr, channel, 0), *rowY = getRow(curr, channel, 1);
+                compareRow(rowX + 1, rowY + 1, getRow(prev, channel, 0) + 1,
+                           getRow(prev, channel, 1) + 1, 0, imageWidth, dy);
+                chainRow(rowX, rowY, imageWidth, -dy);
+                chainRow(rowX, rowY, imageWidth, dy);
+            }
+        };
+        
+        // Pass 0
+        for (int y0 = 0; y0 < imageHeight; y0 += numStripRow) {
+            int numRow = std::min(numStripRow, imageHeight - y0);
+            read(y0, numRow, mask.data());
+            Mapping strip(scratchFile, rowBytes * y0, rowBytes * numRow, true);
+            for (int row = 0; row < numRow; ++row) {
+                int y = y0 + row;
+                for (int channel = 0; channel < numChannel; ++channel) {
+                    int16_t *rowX = getRow(curr, channel, 0), *rowY = getRow(curr, channel, 1);
+                    for (int x = 0; x < imageWidth; ++x) {
+                        const Point& p = (mask[row * imageWidth + x] < 128) != (channel == 1) ?
+                                         outside : inside;
+                        rowX[x + 1] = p.dx;
+                        rowY[x + 1] = p.dy;
+                    }
+                    rowX[0] = rowX[1];
+                    rowY[0] = rowY[1];
+                    rowX[imageWidth + 1] = rowX[imageWidth];
+                    rowY[imageWidth + 1] = rowY[imageWidth];
+                }
+                if (y == 0) copySlot(curr, prev);
+                if (y == imageHeight - 1) copySlot(curr, last);
+                sweep(-1);
+                
+                char* stored = strip.data + rowBytes * row;
+                for (int channel = 0; channel < numChannel; ++channel)
+                    for (int axis = 0; axis < 2; ++axis, stored += paddedWidth * sizeof(int16_t))
+                        memcpy(stored, getRow(curr, channel, axis), paddedWidth * sizeof(int16_t));
+                std::swap(prev, curr);
+            }
+        }
+        
+        // Pass 1
+        copySlot(last, prev);
+        for (int y0 = (imageHeight - 1) / numStripRow * numStripRow; y0 >= 0; y0 -= numStripRow) {
+            int numRow = std::min(numStripRow, imageHeight - y0);
+            {
+                Mapping strip(scratchFile, rowBytes * y0, rowBytes * numRow, false);
+                for (int row = numRow - 1; row >= 0; --row) {
+                    const char* stored = strip.data + rowBytes * row;
+                    for (int channel = 0; channel < numChannel; ++channel)
+                        for (int axis = 0; axis < 2; ++axis, stored += paddedWidth * sizeof(int16_t))
+                            memcpy(getRow(curr, channel, axis), stored, paddedWidth * sizeof(int16_t));
+                    sweep(1);
+                    
+                    const int16_t *outsideX = getRow(curr, 0, 0) + 1, *outsideY = getRow(curr, 0, 1) + 1;
+                    const int16_t *insideX = getRow(curr, numChannel - 1, 0) + 1;
+                    const int16_t *insideY = getRow(curr, numChannel - 1, 1) + 1;
+                    for (int x = 0; x < imageWidth; ++x) {
+                        writeStrip(outsideX[x] * outsideX[x] + outsideY[x] * outsideY[x],
+                                   insideX[x] * insideX[x] + insideY[x] * insideY[x],
+                                   output[row * imageWidth + x]);
+                    }
+                    std::swap(prev, curr);
+                }
+            }
+            write(y0, numRow, output.data());
+        }
+    }
+    
+    SegmentField::SegmentField(const int width, const int height, const float maxDistance,
+                               const int numThread, const int cellSize):
+    imageWidth(width),
+    imageHeight(height),
+    numThread(std::max(numThread, 1)),
+    cellSize(cellSize),
+    numCellX((width + cellSize - 1) / cellSize),
+    numCellY((height + cellSize - 1) / cellSize),
+    maxDistance(maxDistance),
+    halfWidth(0.0f),
+    cellBegin(numCellX * numCellY + 1),
+    firstRing(numCellX * numCellY) {}
+    
+    void SegmentField::operator()(const std::vector<Polyline>& polylines, const float halfWidth,
+                                  int16_t* field, int16_t* gradient) {
+        generate(polylines, halfWidth, field, gradient);
+    }
+    
+    void SegmentField::operator()(const std::vector<Polyline>& polylines, const float halfWidth,
+                                  Half* field, Half* gradient) {
+        generate(polylines, halfWidth, field, gradient);
+    }
+    
+    // put each segment into all cells overlapped by its bounding box
+    void SegmentField::build(const std::vector<Polyline>& polylines, const float halfWidth) {
+        this->halfWidth = halfWidth;
+        segments.clear();
+        for (const Polyline& polyline : polylines) {
+            const int numPoint = (int)polyline.size();
+            for (int i = numPoint > 1 ? 1 : 0; i < numPoint; ++i) {
+                const Vec2 &start = polyline[std::max(i - 1, 0)], &end = polyline[i];
+                float dx = end.x - start.x, dy = end.y - start.y;
+                float lengthSq = dx * dx + dy * dy;
+                segments.push_back({ start.x, start.y, dx, dy, lengthSq > 0.0f ? 1.0f / lengthSq : 0.0f });
+            }
+        }
+        
+        // segments out of the image are put into cells on its edges, which
+        // can only make them look closer when searching
+        auto forEachCell = [&] (const Segment& segment, const std::function<void (int)>& func) {
+            auto toCell = [&] (const float coord, const int numCell) {
+                return (int)std::max(0.0f, std::min(floorf(coord / cellSize), numCell - 1.0f));
+            };
+            int x0 = toCell(std::min(segment.x, segment.x + segment.dx), numCellX);
+            int x1 = toCell(std::max(segment.x, segment.x + segment.dx), numCellX);
+            int y0 = toCell(std::min(segment.y, segment.y + segment.dy), numCellY);
+            int y1 = toCell(std::max(segment.y, segment.y + segment.dy), numCellY);
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x)
+                    func(y * numCellX + x);
+        };
+        std::fill(cellBegin.begin(), cellBegin.end(), 0);
+        for (const Segment& segment : segments)
+            forEachCell(segment, [&] (const int cell) { ++cellBegin[cell + 1]; });
+        for (int i = 0; i < numCellX * numCellY; ++i)
+            cellBegin[i + 1] += cellBegin[i];
+        cellSegments.resize(cellBegin.back());
+        std::vector<int> next(cellBegin.begin(), cellBegin.end() - 1);
+        const int numSegment = (int)segments.size();
+        for (int i = 0; i < numSegment; ++i)
+            forEachCell(segments[i], [&] (const int cell) { cellSegments[next[cell]++] = i; });
+        
+        // chessboard distance to the closest cell with segments (two passes are exact)
+        for (int i = 0; i < numCellX * numCellY; ++i)
+            firstRing[i] = cellBegin[i] == cellBegin[i + 1] ? FAR_AWAY : 0;
+        for (const int dir : { 1, -1 }) {
+            for (int y = dir > 0 ? 0 : numCellY - 1; y >= 0 && y < numCellY; y += dir) {
+                for (int x = dir > 0 ? 0 : numCellX - 1; x >= 0 && x < numCellX; x += dir) {
+                    int& ring = firstRing[y * numCellX + x];
+                    for (const int dx : { -1, 0, 1 }) {
+                        int otherX = x + dx, otherY = y - dir;
+                        if (otherX >= 0 && otherX < numCellX && otherY >= 0 && otherY < numCellY)
+                            ring = std::min(ring, firstRing[otherY * numCellX + otherX] + 1);
+                    }
+                    if (x - dir >= 0 && x - dir < numCellX)
+                        ring = std::min(ring, firstRing[y * numCellX + x - dir] + 1);
+                }
+            }
+        }
+    }
+    
+    // squared distance from a point to segment, and the offset from the closest point on it
+    inline float SegmentField::getDistSq(const Segment& segment, const float x, const float y,
+                                         float& offsetX, float& offsetY) {
+        float t = ((x - segment.x) * segment.dx + (y - segment.y) * segment.dy) * segment.invLengthSq;
+        t = std::max(0.0f, std::min(t, 1.0f));
+        offsetX = x - segment.x - t * segment.dx;
+        offsetY = y - segment.y - t * segment.dy;
+        return offsetX * offsetX + offsetY * offsetY;
+    }
+    
+    /*
+     segments are measured from the center of the tile, visiting cells ring by
+     ring. pixels of the tile are within halfDiagonal from the center, so only
+     segments within (closest + 2 * halfDiagonal) can be the closest one to any
+     pixel, and the search stops once rings are farther than that. returns
+     false (with no candidates) if all pixels are at least maxDistance away
+     */
+    bool SegmentField::findCandidates(const int cellX, const int cellY, Search& search) const {
+        const float centerX = (cellX + 0.5f) * cellSize, centerY = (cellY + 0.5f) * cellSize;
+        const float halfDiagonal = cellSize * (float)M_SQRT1_2;
+        const float cutoff = maxDistance + halfWidth + halfDiagonal;
+        float closest = std::numeric_limits<float>::infinity(), offsetX, offsetY;
+        ++search.stamp;
+        search.found.clear();
+        search.distance.clear();
+        search.candidates.clear();
+        
+        // cells in the ring are at least (ring - 0.5) cells away from the center
+        const int maxRing = std::max(numCellX, numCellY);
+        for (int ring = firstRing[cellY * numCellX + cellX]; ring <= maxRing; ++ring) {
+            if ((ring - 0.5f) * cellSize > std::min(closest + 2.0f * halfDiagonal, cutoff)) break;
+            for (int y = std::max(cellY - ring, 0); y <= std::min(cellY + ring, numCellY - 1); ++y) {
+                bool onEdge = y == cellY - ring || y == cellY + ring;
+                for (int x = cellX - ring; x <= cellX + ring; x += onEdge ? 1 : 2 * ring) {
+                    if (x >= 0 && x < numCellX) {
+                        const int cell = y * numCellX + x;
+                        for (int i = cellBegin[cell]; i < cellBegin[cell + 1]; ++i) {
+                            const int index = cellSegments[i];
+                            if (search.visited[index] == search.stamp) continue;
+                            search.visited[index] = search.stamp;
+                            float distance = sqrtf(getDistSq(segments[index], centerX, centerY, offsetX, offsetY));
+                            search.found.push_back(index);
+                            search.distance.push_back(distance);
+                            closest = std::min(closest, distance);
+                        }
+                    }
+                    if (ring == 0) break;
+                }
+            }
+        }
+        
+        if (closest - halfDiagonal >= maxDistance + halfWidth) return false;
+        const float bound = closest + 2.0f * halfDiagonal;
+        for (size_t i = 0; i < search.found.size(); ++i)
+            if (search.distance[i] <= bound) search.candidates.push_back(search.found[i]);
+        return true;
+    }
+    
+    /*
+     candidates of the tile are narrowed down again for each block of pixels in
+     the same way, so that each pixel only measures a few segments. pixels out
+     of the image are skipped, and stride is in elements of field
+     */
+    template <typename T>
+    void SegmentField::measureTile(const int cellX, const int cellY, Search& search,
+                                   T* field, const int stride, T* gradient) const {
+        const int width = std::min(cellSize, imageWidth - cellX * cellSize);
+        const int height = std::min(cellSize, imageHeight - cellY * cellSize);
+        const float halfDiagonal = BLOCK_SIZE * (float)M_SQRT1_2;
+        float offsetX, offsetY;
+        for (int blockY = 0; blockY < height; blockY += BLOCK_SIZE) {
+            for (int blockX = 0; blockX < width; blockX += BLOCK_SIZE) {
+                float centerX = cellX * cellSize + blockX + BLOCK_SIZE * 0.5f;
+                float centerY = cellY * cellSize + blockY + BLOCK_SIZE * 0.5f;
+                float closest = std::numeric_limits<float>::infinity();
+                search.distance.clear();
+                for (const int index : search.candidates) {
+                    search.distance.push_back(sqrtf(getDistSq(segments[index], centerX, centerY,
+                                                              offsetX, offsetY)));
+                    closest = std::min(closest, search.distance.back());
+                }
+                search.nearby.clear();
+                if (closest - halfDiagonal < maxDistance + halfWidth) { // otherwise all clamped
+                    for (size_t i = 0; i < search.candidates.size(); ++i)
+                        if (search.distance[i] <= closest + 2.0f * halfDiagonal)
+                            search.nearby.push_back(search.candidates[i]);
+                }
+                
+                // pixels of the block are measured together for each segment, which vectorizes
+                float pixelX[BLOCK_AREA], pixelY[BLOCK_AREA];
+                float closestSq[BLOCK_AREA], closestX[BLOCK_AREA], closestY[BLOCK_AREA];
+                for (int i = 0; i < BLOCK_AREA; ++i) {
+                    pixelX[i] = centerX + i % BLOCK_SIZE - (BLOCK_SIZE - 1) * 0.5f;
+                    pixelY[i] = centerY + i / BLOCK_SIZE - (BLOCK_SIZE - 1) * 0.5f;
+                    closestSq[i] = std::numeric_limits<float>::infinity();
+                    closestX[i] = closestY[i] = 0.0f;
+                }
+                for (const int index : search.nearby) {
+                    const Segment segment = segments[index];
+                    for (int i = 0; i < BLOCK_AREA; ++i) {
+                        float distSq = getDistSq(segment, pixelX[i], pixelY[i], offsetX, offsetY);
+                        bool isCloser = distSq < closestSq[i];
+                        closestSq[i] = isCloser ? distSq : closestSq[i];
+                        closestX[i] = isCloser ? offsetX : closestX[i];
+                        closestY[i] = isCloser ? offsetY : closestY[i];
+                    }
+                }
+                
+                for (int r = blockY; r < std::min(blockY + BLOCK_SIZE, height); ++r) {
+                    for (int c = blockX; c < std::min(blockX + BLOCK_SIZE, width); ++c) {
+                        int i = (r - blockY) * BLOCK_SIZE + c - blockX;
+                        float length = sqrtf(closestSq[i]);
+                        float dist = std::min(length - halfWidth, maxDistance);
+                        encode(dist, field[r * stride + c]);
+                        if (!gradient) continue;
+                        bool isFlat = dist >= maxDistance || length == 0.0f;
+                        encodeGradient(isFlat ? 0.0f : closestX[i] / length, gradient[(r * stride + c) * 2]);
+                        encodeGradient(isFlat ? 0.0f : closestY[i] / length, gradient[(r * stride + c) * 2 + 1]);
+                    }
+                }
+            }
+        }
+    }
+    
+    // tiles far away have no candidates, so measuring them simply fills maxDistance
+    template <typename T>
+    void SegmentField::generate(const std::vector<Polyline>& polylines, const float halfWidth,
+                                T* field, T* gradient) {
+        build(polylines, halfWidth);
+        parallelFor(numThread, numCellX * numCellY, [&] (const int begin, const int end) {
+            Search search((int)segments.size());
+            for (int i = begin; i < end; ++i) {
+                const int cellX = i % numCellX, cellY = i / numCellX;
+                const int offset = cellY * cellSize * imageWidth + cellX * cellSize;
+                findCandidates(cellX, cellY, search);
+                measureTile(cellX, cellY, search, field + offset, imageWidth,
+                            gradient ? gradient + offset * 2 : nullptr);
+            }
+        });
+    }
+    
+    NarrowBand::NarrowBand(const int width, const int height, const int tileSize,
+                           const float maxDistance, const int numThread):
+    imageWidth(width),
+    imageHeight(height),
+    tileSize(tileSize),
+    numTileX((width + tileSize - 1) / tileSize),
+    numTileY((height + tileSize - 1) / tileSize),
+    numThread(std::max(numThread, 1)),
+    maxDistance(maxDistance),
+    atlasTileX(1),
+    atlasTileY(1),
+    slots(numTileX * numTileY, { FAR_TILE, FAR_TILE }),
+    segmentField(width, height, maxDistance, numThread, tileSize) {}
+    
+    void NarrowBand::operator()(const unsigned char* mask) {
+        // find tiles that contain paths
+        std::vector<char> hasPath(numTileX * numTileY, false);
+        parallelFor(numThread, numTileY, [&] (const int tyBegin, const int tyEnd) {
+            for (int y = tyBegin * tileSize; y < std::min(tyEnd * tileSize, imageHeight); ++y)
+                for (int x = 0; x < imageWidth; ++x)
+                    if (mask[y * imageWidth + x] >= 128)
+                        hasPath[(y / tileSize) * numTileX + x / tileSize] = true;
+        });
+        
+        // any pixel closer than radius to paths is at most reach tiles away
+        // from them. the band is found by dilating tiles with paths
+        int radius = (int)ceil(maxDistance) + 1;
+        int reach = (radius - 1) / tileSize + 1;
+        auto dilate = [&] (const std::vector<char>& tiles, const int strideAlong,
+                           const int strideAcross, const int numAlong, const int numAcross) {
+            std::vector<char> dilated(tiles.size(), false);
+            for (int j = 0; j < numAcross; ++j) {
+                for (int i = 0; i < numAlong; ++i) {
+                    if (!tiles[j * strideAcross + i * strideAlong]) continue;
+                    for (int k = std::max(i - reach, 0); k <= std::min(i + reach, numAlong - 1); ++k)
+                        dilated[j * strideAcross + k * strideAlong] = true;
+                }
+            }
+            return dilated;
+        };
+        std::vector<char> inBand = dilate(dilate(hasPath, 1, numTileX, numTileX, numTileY),
+                                          numTileX, 1, numTileY, numTileX);
+        
+        allocate(inBand);
+        distSq.resize(bandTiles.size() * tileSize * tileSize);
+        for (const bool inverted : { false, true }) {
+            transform(mask, inverted);
+            writeAtlas(mask, inverted);
+        }
+        fillBorders();
+    }
+    
+    // a tile is in the band if any segment may be closer than maxDistance to it
+    void NarrowBand::operator()(const std::vector<Polyline>& polylines, const float halfWidth) {
+        segmentField.build(polylines, halfWidth);
+        std::vector<char> inBand(numTileX * numTileY);
+        parallelFor(numThread, numTileX * numTileY, [&] (const int begin, const int end) {
+            SegmentField::Search search((int)segmentField.segments.size());
+            for (int i = begin; i < end; ++i)
+                inBand[i] = segmentField.findCandidates(i % numTileX, i / numTileX, search);
+        });
+        allocate(inBand);
+        
+        const int atlasWidth = getAtlasWidth();
+        parallelFor(numThread, (int)bandTiles.size(), [&] (const int begin, const int end) {
+            SegmentField::Search search((int)segmentField.segments.size());
+            for (int i = begin; i < end; ++i) {
+                int tx = bandTiles[i] % numTileX, ty = bandTiles[i] / numTileX;
+                const Slot& slot = slots[bandTiles[i]];
+                Half *texels = atlas.data() + (slot.y * (tileSize + 2) + 1) * atlasWidth
+                               + slot.x * (tileSize + 2) + 1;
+                segmentField.findCandidates(tx, ty, search);
+                segmentField.measureTile(tx, ty, search, texels, atlasWidth, (Half *)nullptr);
+            }
+        });
+        fillBorders();
+    }
+    
+    // allocate slots in the atlas (kept roughly square), and fill it with maxDistance
+    void NarrowBand::allocate(const std::vector<char>& inBand) {
+        bandTiles.clear();
+        const int numTile = (int)inBand.size();
+        for (int i = 0; i < numTile; ++i)
+            if (inBand[i]) bandTiles.push_back(i);
+        int numBand = (int)bandTiles.size();
+        atlasTileX = std::max(1, (int)ceil(sqrt((double)numBand)));
+        atlasTileY = std::max(1, (numBand + atlasTileX - 1) / atlasTileX);
+        std::fill(slots.begin(), slots.end(), Slot { FAR_TILE, FAR_TILE });
+        for (int i = 0; i < numBand; ++i)
+            slots[bandTiles[i]] = { (int16_t)(i % atlasTileX), (int16_t)(i / atlasTileX) };
+        
+        Half farAway;
+        encode(maxDistance, farAway);
+        atlas.assign(getAtlasWidth() * getAtlasHeight(), farAway);
+    }
+    
+    int NarrowBand::getNumTileX() const {
+        return numTileX;
+    }
+    
+    int NarrowBand::getNumTileY() const {
+        return numTileY;
+    }
+    
+    int NarrowBand::getNumBandTile() const {
+        return (int)bandTiles.size();
+    }
+    
+    const std::vector<NarrowBand::Slot>& NarrowBand::getSlots() const {
+        return slots;
+    }
+    
+    int NarrowBand::getAtlasWidth() const {
+        return atlasTileX * (tileSize + 2);
+    }
+    
+    int NarrowBand::getAtlasHeight() const {
+        return atlasTileY * (tileSize + 2);
+    }
+    
+    const Half* NarrowBand::getAtlas() const {
+        return atlas.data();
+    }
+    
+    // squared distances of a tile, or nullptr if it is far away
+    inline int* NarrowBand::getTile(const int tileX, const int tileY) {
+        const Slot& slot = slots[tileY * numTileX + tileX];
+        if (slot.x == FAR_TILE) return nullptr;
+        return distSq.data() + (slot.y * atlasTileX + slot.x) * tileSize * tileSize;
+    }
+    
+    /*
+     the same as Generator::generateEDT(), but far away tiles are regarded as
+     gaps that have nothing to measure distance to. this only affects pixels
+     that are farther than maxDistance, since any pixel between one in the band
+     and its closest path pixel is also in the band
+     */
+    void NarrowBand::transform(const unsigned char* mask, const bool inverted) {
+        auto isTarget = [&] (const int x, const int y) {
+            if (x >= imageWidth || y >= imageHeight) return false; // out of image
+            return (mask[y * imageWidth + x] < 128) == inverted;
+        };
+        
+        // pass 0: distance to the closest target pixel in the same column
+        parallelFor(numThread, numTileX, [&] (const int txBegin, const int txEnd) {
+            std::vector<int> prev(tileSize);
+            for (int tx = txBegin; tx < txEnd; ++tx) {
+                std::fill(prev.begin(), prev.end(), FAR_AWAY);
+                for (int ty = 0; ty < numTileY; ++ty) {
+                    int *tile = getTile(tx, ty);
+                    if (!tile) {
+                        std::fill(prev.begin(), prev.end(), FAR_AWAY);
+                        continue;
+                    }
+                    for (int r = 0; r < tileSize; ++r) {
+                        for (int c = 0; c < tileSize; ++c) {
+                            prev[c] = isTarget(tx * tileSize + c, ty * tileSize + r) ?
+                                      0 : std::min(prev[c] + 1, FAR_AWAY);
+                            tile[r * tileSize + c] = prev[c];
+                        }
+                    }
+                }
+                std::fill(prev.begin(), prev.end(), FAR_AWAY);
+                for (int ty = numTileY - 1; ty >= 0; --ty) {
+                    int *tile = getTile(tx, ty);
+                    if (!tile) {
+                        std::fill(prev.begin(), prev.end(), FAR_AWAY);
+                        continue;
+                    }
+                    for (int r = tileSize - 1; r >= 0; --r) {
+                        for (int c = 0; c < tileSize; ++c) {
+                            prev[c] = std::min(tile[r * tileSize + c], prev[c] + 1);
+                            tile[r * tileSize + c] = prev[c];
+                        }
+                    }
+                }
+            }
+        });
+        
+        // pass 1: lower envelope along each run of tiles in the band
+        parallelFor(numThread, numTileY, [&] (const int tyBegin, const int tyEnd) {
+            std::vector<int> row(numTileX * tileSize);
+            Envelope envelope(numTileX * tileSize);
+            for (int ty = tyBegin; ty < tyEnd; ++ty) {
+                for (int begin = 0, end = 0; begin < numTileX; begin = end) {
+                    if (!getTile(begin, ty)) {
+                        end = begin + 1;
+                        continue;
+                    }
+                    for (end = begin + 1; end < numTileX && getTile(end, ty); ++end);
+                    for (int r = 0; r < tileSize; ++r) {
+                        for (int tx = begin; tx < end; ++tx)
+                            memcpy(&row[(tx - begin) * tileSize], getTile(tx, ty) + r * tileSize,
+                                   tileSize * sizeof(int));
+                        lowerEnvelope(row.data(), (end - begin) * tileSize, envelope);
+                        for (int tx = begin; tx < end; ++tx)
+                            memcpy(getTile(tx, ty) + r * tileSize, &row[(tx - begin) * tileSize],
+                                   tileSize * sizeof(int));
+                    }
+                }
+            }
+        });
+    }
+    
+    // same as Generator::generateSigned(), but written to slots in the atlas
+    void NarrowBand::writeAtlas(const unsigned char* mask, const bool inverted) {
+        const int atlasWidth = getAtlasWidth();
+        parallelFor(numThread, (int)bandTiles.size(), [&] (const int begin, const int end) {
+            for (int i = begin; i < end; ++i) {
+                int tx = bandTiles[i] % numTileX, ty = bandTiles[i] / numTileX;
+                const Slot& slot = slots[bandTiles[i]];
+                const int *tile = distSq.data() + i * tileSize * tileSize;
+                Half *texels = atlas.data() + (slot.y * (tileSize + 2) + 1) * atlasWidth
+                               + slot.x * (tileSize + 2) + 1;
+                for (int r = 0; r < tileSize; ++r) {
+                    for (int c = 0; c < tileSize; ++c) {
+                        int x = tx * tileSize + c, y = ty * tileSize + r;
+                        if (x >= imageWidth || y >= imageHeight) continue; // stay far away
+                        if ((mask[y * imageWidth + x] < 128) == inverted) continue; // written by the other pass
+                        float dist = std::min(sqrt((float)tile[r * tileSize + c]) - 0.5f, maxDistance);
+                        encode(inverted ? -dist : dist, texels[r * atlasWidth + c]);
+                    }
+                }
+            }
+        });
+    }
+    
+    // copy texels on edges of neighbours, if they are in the band and in the image
+    void NarrowBand::fillBorders() {
+        const int atlasWidth = getAtlasWidth();
+        auto texelAt = [&] (const Slot& slot, const int c, const int r) -> Half& {
+            return atlas[(slot.y * (tileSize + 2) + 1 + r) * atlasWidth + slot.x * (tileSize + 2) + 1 + c];
+        };
+        parallelFor(numThread, (int)bandTiles.size(), [&] (const int begin, const int end) {
+            for (int i = begin; i < end; ++i) {
+                int tx = bandTiles[i] % numTileX, ty = bandTiles[i] / numTileX;
+                const Slot& slot = slots[bandTiles[i]];
+                for (int r = -1; r <= tileSize; ++r) {
+                    for (int c = -1; c <= tileSize; ++c) {
+                        if (r >= 0 && r < tileSize && c >= 0 && c < tileSize) continue; // not on border
+                        int x = tx * tileSize + c, y = ty * tileSize + r;
+                        if (x < 0 || x >= imageWidth || y < 0 || y >= imageHeight) continue;
+                        const Slot& other = slots[(y / tileSize) * numTileX + x / tileSize];
+                        if (other.x == FAR_TILE) continue;
+                        texelAt(slot, c, r) = texelAt(other, x % tileSize, y % tileSize);
+                    }
+                }
+            }
+        });
+    }
 }
@@ -0,0 +1,148 @@
+//
+//  fieldcache.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "fieldcache.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using namespace std;
+
+static const char* FIELD_EXTENSION = ".field";
+
+const char* FieldCache::Blob::getData() const {
+    return mapped ? (const char *)mapped : owned.data();
+}
+
+size_t FieldCache::Blob::getSize() const {
+    return mapped ? mappedSize : owned.size();
+}
+
+FieldCache::Blob::~Blob() {
+    if (mapped) munmap(mapped, mappedSize);
+}
+
+FieldCache::Key FieldCache::hash(const void* data, const size_t size, const Key seed) {
+    Key hash = seed;
+    const unsigned char* bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+FieldCache::FieldCache(const size_t memoryBudget, const string& directory, const size_t diskBudget):
+memoryBudget(memoryBudget), diskBudget(diskBudget), memorySize(0), directory(directory) {
+    if (!directory.empty()) mkdir(directory.c_str(), 0755); // may already exist
+}
+
+shared_ptr<const FieldCache::Blob> FieldCache::find(const Key key) {
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        recent.splice(recent.begin(), recent, found->second);
+        return recent.front().second;
+    }
+    if (directory.empty()) return nullptr;
+    
+    string path = getPath(key);
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return nullptr;
+    struct stat info;
+    void* mapped = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size > 0)
+        mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file); // the mapping stays valid
+    if (mapped == MAP_FAILED) return nullptr;
+    utimes(path.c_str(), nullptr); // recently used
+    
+    shared_ptr<Blob> blob(new Blob);
+    blob->mapped = mapped;
+    blob->mappedSize = info.st_size;
+    keep(key, blob);
+    return blob;
+}
+
+shared_ptr<const FieldCache::Blob> FieldCache::insert(const Key key, vector<char>&& data) {
+    shared_ptr<Blob> blob(new Blob);
+    blob->owned = move(data);
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        memorySize -= found->second->second->getSize();
+        recent.erase(found->second);
+        entries.erase(found);
+    }
+    keep(key, blob);
+    
+    // written to another file first, so that a file is either complete or missing
+    if (!directory.empty()) {
+        string path = getPath(key), partial = path + ".partial";
+        FILE* file = fopen(partial.c_str(), "wb");
+        if (file) {
+            bool isWritten = fwrite(blob->getData(), 1, blob->getSize(), file) == blob->getSize();
+            isWritten = fclose(file) == 0 && isWritten;
+            if (isWritten && rename(partial.c_str(), path.c_str()) == 0) trimDisk();
+            else remove(partial.c_str());
+        }
+    }
+    return blob;
+}
+
+string FieldCache::getPath(const Key key) const {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return directory + "/" + name + FIELD_EXTENSION;
+}
+
+// fields larger than memoryBudget are never kept
+void FieldCache::keep(const Key key, const shared_ptr<const Blob>& blob) {
+    if (blob->getSize() > memoryBudget) return;
+    recent.emplace_front(key, blob);
+    entries[key] = recent.begin();
+    memorySize += blob->getSize();
+    while (memorySize > memoryBudget) {
+        memorySize -= recent.back().second->getSize();
+        entries.erase(recent.back().first);
+        recent.pop_back();
+    }
+}
+
+// files are removed from the least recently used (modified) one
+void FieldCache::trimDisk() {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    struct File { string path; time_t usedTime; size_t size; };
+    vector<File> files;
+    size_t totalSize = 0;
+    size_t extensionLength = string(FIELD_EXTENSION).size();
+    while (dirent* entry = readdir(dir)) {
+        string name = entry->d_name;
+        if (name.size() <= extensionLength ||
+            name.compare(name.size() - extensionLength, extensionLength, FIELD_EXTENSION) != 0)
+            continue;
+        string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) continue;
+        files.push_back({ path, info.st_mtime, (size_t)info.st_size });
+        totalSize += info.st_size;
+    }
+    closedir(dir);
+    
+    sort(files.begin(), files.end(), [] (const File& a, const File& b) { return a.usedTime < b.usedTime; });
+    for (const File& file : files) {
+        if (totalSize <= diskBudget) break;
+        if (remove(file.path.c_str()) == 0) totalSize -= file.size;
+    }
+}
@@ -0,0 +1,152 @@
+//
+//  jumpflood.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "jumpflood.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace DistanceField {
+    // same as jumpflood.cs
+    enum { SEED_PASS, FLOOD_PASS, BYTE_PASS, ATLAS_PASS };
+    static const int GROUP_SIZE = 8;
+    
+    bool JumpFlood::isSupported() {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 4 || (major == 4 && minor >= 3);
+    }
+    
+    JumpFlood::JumpFlood(const int width, const int height, const int tileSize, const float maxDistance,
+                         const int numLayer):
+    imageWidth(width),
+    imageHeight(height),
+    tileSize(tileSize),
+    numTileX((width + tileSize - 1) / tileSize),
+    numTileY((height + tileSize - 1) / tileSize),
+    numLayer(numLayer),
+    maxDistance(maxDistance),
+    shader("jumpflood.cs") {
+        if (width > 32767 || height > 32767) throw std::runtime_error("Image too large for jump flooding");
+        
+        glGenTextures(2, seeds);
+        glGenTextures(1, &maskTex);
+        glGenTextures(1, &byteTex);
+        for (int i = 0; i < 2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, seeds[i]);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16I, width, height);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, maskTex);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8, width, height, 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glBindTexture(GL_TEXTURE_2D, byteTex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        
+        slots.reserve(numTileX * numTileY * numLayer);
+        for (int y = 0; y < numTileY * numLayer; ++y)
+            for (int x = 0; x < numTileX; ++x)
+                slots.push_back({ (int16_t)x, (int16_t)y });
+        
+        shader.use();
+        shader.setInt("tileSize", tileSize);
+        shader.setFloat("maxDistance", maxDistance);
+    }
+    
+    void JumpFlood::operator()(unsigned char* image) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, maskTex);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, imageWidth, imageHeight, 1,
+                        GL_RED, GL_UNSIGNED_BYTE, image);
+        
+        int result = flood(maskTex, 0);
+        glBindImageTexture(0, seeds[result], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16I);
+        glBindImageTexture(2, byteTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+        dispatch(BYTE_PASS, imageWidth, imageHeight);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        
+        glBindTexture(GL_TEXTURE_2D, byteTex);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, image);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    
+    void JumpFlood::operator()(const GLuint mask, const GLuint atlas) {
+        // half floats are written as their bits, since conversion may round up
+        glBindImageTexture(3, atlas, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16UI);
+        for (int layer = 0; layer < numLayer; ++layer) {
+            int result = flood(mask, layer);
+            glBindImageTexture(0, seeds[result], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16I);
+            dispatch(ATLAS_PASS, getAtlasWidth(), numTileY * (tileSize + 2));
+        }
+    }
+    
+    int JumpFlood::getNumTileX() const {
+        return numTileX;
+    }
+    
+    int JumpFlood::getNumTileY() const {
+        return numTileY;
+    }
+    
+    int JumpFlood::getAtlasWidth() const {
+        return numTileX * (tileSize + 2);
+    }
+    
+    int JumpFlood::getAtlasHeight() const {
+        return numTileY * numLayer * (tileSize + 2);
+    }
+    
+    const std::vector<NarrowBand::Slot>& JumpFlood::getSlots() const {
+        return slots;
+    }
+    
+    JumpFlood::~JumpFlood() {
+        glDeleteTextures(2, seeds);
+        glDeleteTextures(1, &maskTex);
+        glDeleteTextures(1, &byteTex);
+    }
+    
+    void JumpFlood::dispatch(const int pass, const int width, const int height) {
+        shader.setInt("pass", pass);
+        glDispatchCompute((width + GROUP_SIZE - 1) / GROUP_SIZE, (height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    }
+    
+    int JumpFlood::flood(const GLuint mask, const int layer) {
+        GLint unit;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+        shader.use();
+        shader.setInt("mask", unit - GL_TEXTURE0);
+        shader.setInt("layer", layer);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, mask);
+        glBindImageTexture(1, seeds[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16I);
+        dispatch(SEED_PASS, imageWidth, imageHeight);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        
+        // steps of half of the image, ..., 2, 1, and then 2, 1 again
+        std::vector<int> steps;
+        int largest = 1;
+        while (largest * 2 < std::max(imageWidth, imageHeight)) largest *= 2;
+        for (int step = largest; step >= 1; step /= 2) steps.push_back(step);
+        steps.push_back(2);
+        steps.push_back(1);
+        
+        int current = 0;
+        for (int step : steps) {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            glBindImageTexture(0, seeds[current], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16I);
+            glBindImageTexture(1, seeds[1 - current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16I);
+            shader.setInt("step", step);
+            dispatch(FLOOD_PASS, imageWidth, imageHeight);
+            current = 1 - current;
+        }
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        return current;
+    }
+}
@@ -95,6 +95,14 @@ namespace Loader {
         }
     }
     
+    vector<unsigned char> readImage(const string& path, int& width, int& height, int& channel) {
+        stbi_uc *data = stbi_load(path.c_str(), &width, &height, &channel, 0);
+        if (!data) throw runtime_error("Failed to load image from " + path);
+        vector<unsigned char> image(data, data + (size_t)width * height * channel);
+        stbi_image_free(data);
+        return image;
+    }
+    
     GLuint loadCubemap(const string& path,
                        const vector<string>& filename,
                        const bool gammaCorrection) {
@@ -0,0 +1,161 @@
+//
+//  pathmask.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "pathmask.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using DistanceField::Polyline;
+using DistanceField::Vec2;
+
+namespace PathMask {
+    Rasterizer::Rasterizer(const int width, const int height, const int numThread,
+                           const int tileSize):
+    imageWidth(width),
+    imageHeight(height),
+    numThread(std::max(numThread, 1)),
+    tileSize(tileSize),
+    numTileX((width + tileSize - 1) / tileSize),
+    numTileY((height + tileSize - 1) / tileSize),
+    tileBegin(numTileX * numTileY + 1) {}
+    
+    void Rasterizer::operator()(const std::vector<Polyline>& polylines, const float halfWidth,
+                                unsigned char* mask) {
+        build(polylines, halfWidth + 0.5f);
+        
+        // tiles are taken one by one, since paths are usually crowded in a few of them
+        std::atomic<int> nextTile(0);
+        auto drawTiles = [&] {
+            for (int tile = nextTile++; tile < numTileX * numTileY; tile = nextTile++)
+                drawTile(tile % numTileX, tile / numTileX, halfWidth, mask);
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < numThread; ++i) threads.emplace_back(drawTiles);
+        drawTiles();
+        for (std::thread& thread : threads) thread.join();
+    }
+    
+    // a segment is put into each tile that its bounding box (expanded by radius) overlaps
+    void Rasterizer::build(const std::vector<Polyline>& polylines, const float radius) {
+        segments.clear();
+        for (const Polyline& polyline : polylines) {
+            const int numPoint = (int)polyline.size();
+            for (int i = 0; i < numPoint; ++i) {
+                const Vec2 &start = polyline[i], &end = polyline[std::min(i + 1, numPoint - 1)];
+                if (i > 0 && i == numPoint - 1) break; // a single point makes a dot
+                float dx = end.x - start.x, dy = end.y - start.y;
+                segments.push_back({ start.x, start.y, dx, dy, sqrt(dx * dx + dy * dy) });
+            }
+        }
+        
+        auto tileRange = [&] (const Segment& segment, int& x0, int& y0, int& x1, int& y1) {
+            x0 = std::max((int)floor((std::min(segment.x, segment.x + segment.dx) - radius) / tileSize), 0);
+            y0 = std::max((int)floor((std::min(segment.y, segment.y + segment.dy) - radius) / tileSize), 0);
+            x1 = std::min((int)floor((std::max(segment.x, segment.x + segment.dx) + radius) / tileSize), numTileX - 1);
+            y1 = std::min((int)floor((std::max(segment.y, segment.y + segment.dy) + radius) / tileSize), numTileY - 1);
+        };
+        std::fill(tileBegin.begin(), tileBegin.end(), 0);
+        for (const Segment& segment : segments) {
+            int x0, y0, x1, y1;
+            tileRange(segment, x0, y0, x1, y1);
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x)
+                    ++tileBegin[y * numTileX + x + 1];
+        }
+        for (int i = 0; i < numTileX * numTileY; ++i) tileBegin[i + 1] += tileBegin[i];
+        tileSegments.resize(tileBegin.back());
+        std::vector<int> filled(tileBegin.begin(), tileBegin.end() - 1);
+        const int numSegment = (int)segments.size();
+        for (int i = 0; i < numSegment; ++i) {
+            int x0, y0, x1, y1;
+            tileRange(segments[i], x0, y0, x1, y1);
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x)
+                    tileSegments[filled[y * numTileX + x]++] = i;
+        }
+    }
+    
+    // narrows [lo, hi] to x where a * x + b is in [min, max]
+    static inline void clipSpan(const float a, const float b, const float min, const float max,
+                                float& lo, float& hi) {
+        if (fabs(a) < 1e-6f) {
+            if (b < min || b > max) hi = -INFINITY;
+            return;
+        }
+        float first = (min - b) / a, second = (max - b) / a;
+        lo = std::max(lo, std::min(first, second));
+        hi = std::min(hi, std::max(first, second));
+    }
+    
+    // extends [lo, hi] to cover a disc of radius at (x, y) on row at height cy
+    static inline void addDisc(const float x, const float y, const float radius, const float cy,
+                               float& lo, float& hi) {
+        float offsetSq = radius * radius - (cy - y) * (cy - y);
+        if (offsetSq < 0.0f) return;
+        float offset = sqrt(offsetSq);
+        lo = std::min(lo, x - offset);
+        hi = std::max(hi, x + offset);
+    }
+    
+    /*
+     a segment covers a capsule, which is convex, so its span on a row is the
+     hull of the spans of both end discs and of the rectangle between them
+     */
+    void Rasterizer::drawTile(const int tileX, const int tileY, const float halfWidth,
+                              unsigned char* mask) const {
+        const int x0 = tileX * tileSize, x1 = std::min(x0 + tileSize, imageWidth);
+        const int y0 = tileY * tileSize, y1 = std::min(y0 + tileSize, imageHeight);
+        const float radius = halfWidth + 0.5f;
+        for (int y = y0; y < y1; ++y) memset(mask + y * imageWidth + x0, 0, x1 - x0);
+        
+        const int tile = tileY * numTileX + tileX;
+        for (int i = tileBegin[tile]; i < tileBegin[tile + 1]; ++i) {
+            const Segment& segment = segments[tileSegments[i]];
+            float ux = 0.0f, uy = 0.0f;
+            if (segment.length > 0.0f) {
+                ux = segment.dx / segment.length;
+                uy = segment.dy / segment.length;
+            }
+            for (int y = y0; y < y1; ++y) {
+                float cy = y + 0.5f, lo = INFINITY, hi = -INFINITY;
+                addDisc(segment.x, segment.y, radius, cy, lo, hi);
+                addDisc(segment.x + segment.dx, segment.y + segment.dy, radius, cy, lo, hi);
+                if (segment.length > 0.0f) {
+                    // along the segment in [0, length], and across it in [-radius, radius]
+                    float rectLo = -INFINITY, rectHi = INFINITY;
+                    clipSpan(ux, (cy - segment.y) * uy - segment.x * ux, 0.0f, segment.length,
+                             rectLo, rectHi);
+                    clipSpan(-uy, (cy - segment.y) * ux + segment.x * uy, -radius, radius,
+                             rectLo, rectHi);
+                    if (rectLo <= rectHi) {
+                        lo = std::min(lo, rectLo);
+                        hi = std::max(hi, rectHi);
+                    }
+                }
+                if (lo > hi) continue;
+                
+                // pixels whose centers are in [lo, hi]
+                int begin = std::max((int)ceil(lo - 0.5f), x0), end = std::min((int)floor(hi - 0.5f) + 1, x1);
+                unsigned char* row = mask + y * imageWidth;
+                for (int x = begin; x < end; ++x) {
+                    float px = x + 0.5f - segment.x, py = cy - segment.y;
+                    float t = segment.length > 0.0f ?
+                              std::max(0.0f, std::min(px * ux + py * uy, segment.length)) : 0.0f;
+                    float dist = hypot(px - t * ux, py - t * uy);
+                    float coverage = std::max(0.0f, std::min(radius - dist, 1.0f));
+                    row[x] = std::max(row[x], (unsigned char)(coverage * 255.0f));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,670 @@
+//
+//  raymarch.cpp
+//  Draw My Aurora
+//
+//  Created by Pujun Lun on 10/17/26.
+//  Copyright © 2026 Pujun Lun. All rights reserved.
+//
+
+#include "raymarch.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAYMARCH_X86
+#include <immintrin.h>
+#endif
+
+// avx512f also enables FMA, and products fused into additions would round
+// differently from the scalar version
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include "airtrans.hpp"
+
+using namespace glm;
+
+namespace RayMarch {
+    Texture::Texture(const int width, const int height, const int numLayer, const int numChannel,
+                     const bool isRepeated):
+    width(width),
+    height(height),
+    numLayer(numLayer),
+    numChannel(numChannel),
+    isRepeated(isRepeated),
+    texels((size_t)width * height * numLayer * numChannel) {}
+    
+    Texture Texture::fromBytes(const unsigned char* bytes, const int width, const int height,
+                               const int numChannel, const bool isSRGB) {
+        Texture texture(width, height, 1, numChannel);
+        for (size_t i = 0; i < texture.texels.size(); ++i) {
+            float value = bytes[i] / 255.0f;
+            if (isSRGB && (numChannel < 4 || i % 4 != 3))
+                value = value <= 0.04045f ? value / 12.92f : pow((value + 0.055f) / 1.055f, 2.4f);
+            texture.texels[i] = value;
+        }
+        return texture;
+    }
+    
+    vec4 Texture::fetch(const int x, const int y, const int layer) const {
+        vec4 texel(0.0f, 0.0f, 0.0f, 1.0f);
+        const float* source = texels.data() + (((size_t)layer * height + y) * width + x) * numChannel;
+        for (int c = 0; c < numChannel; ++c) texel[c] = source[c];
+        return texel;
+    }
+    
+    vec4 Texture::sample(const vec2& uv, const int layer) const {
+        auto wrap = [&] (const int index, const int size) {
+            return isRepeated ? (index % size + size) % size : std::min(std::max(index, 0), size - 1);
+        };
+        vec2 pos = uv * vec2(width, height) - 0.5f;
+        vec2 base = floor(pos), weight = pos - base;
+        int x0 = wrap((int)base.x, width), x1 = wrap((int)base.x + 1, width);
+        int y0 = wrap((int)base.y, height), y1 = wrap((int)base.y + 1, height);
+        int clamped = std::min(std::max(layer, 0), numLayer - 1);
+        return mix(mix(fetch(x0, y0, clamped), fetch(x1, y0, clamped), weight.x),
+                   mix(fetch(x0, y1, clamped), fetch(x1, y1, clamped), weight.x), weight.y);
+    }
+    
+    void Scene::setAirTrans(const float sampleStep) {
+        int numSample = (int)(1.0f / sampleStep) + 1;
+        std::vector<unsigned char> image(numSample);
+        AirTrans::generate(image.data(), sampleStep);
+        airTrans = Texture::fromBytes(image.data(), numSample, 1, 1, false);
+    }
+    
+    // the rest follows aurora.fs, with the same names
+    const float km = 1.0f / 6378.1f;
+    const float miss_t = 100.0f;
+    const float dt = 2.0f * km;
+    const float auroraScale = dt / (40.0f * km);
+    const float airSampleStep = 0.01f;
+    const vec3 airColor = 0.002f * vec3(0.4f, 0.5f, 0.7f);
+    const vec3 origin = vec3(0.0f, -1.0f, 0.0f);
+    const int MAX_CASCADES = 4;
+    
+    struct ray {
+        vec3 S, D;
+    };
+    static vec3 ray_at(const ray& r, const float t) { return r.S + r.D * t; }
+    
+    struct span {
+        float l, h;
+    };
+    
+    struct sphere {
+        vec3 center;
+        float r;
+    };
+    
+    static span span_sphere(const sphere& s, const ray& r) {
+        float b = 2.0f * dot(r.S - s.center, r.D);
+        float c = dot(r.S - s.center, r.S - s.center) - s.r * s.r;
+        float det = b * b - 4.0f * c;
+        if (det < 0.0f) return { miss_t, miss_t };
+        float sd = sqrt(det);
+        return { (-b - sd) * 0.5f, (-b + sd) * 0.5f };
+    }
+    
+    static vec3 deposition_function(const Scene& scene, float height) {
+        height -= 1.0f;
+        float maxHeight = 300.0f * km;
+        return vec3(scene.deposition.sample(vec2(0.8f, height / maxHeight)));
+    }
+    
+    static float air_transmit(const Scene& scene, const float cosVal) {
+        int numStep = (int)round(1.0f / airSampleStep) + 1;
+        float stepSize = 1.0f / numStep;
+        float xOffset = (1.0f - stepSize) * cosVal + stepSize / 2.0f;
+        return scene.airTrans.sample(vec2(xOffset, 0.5f)).r * 255.0f / 200.0f;
+    }
+    
+    static vec3 tone_map(const vec3& color) {
+        float len = length(color);
+        return color * pow(len, 1.0f / 2.2f - 1.0f);
+    }
+    
+    static vec2 down_to_map(const vec3& worldPos) {
+        vec3 direction = worldPos - origin;
+        float t = (1.0f - origin.y) / direction.y;
+        vec2 samplePos = vec2(origin.x, origin.z) + vec2(direction.x, direction.z) * t;
+        return (samplePos + 2.0f) / 4.0f;
+    }
+    
+    static vec3 to_cascade(const Scene& scene, const vec2& uv) {
+        for (int i = std::min(scene.paths.numLayer, MAX_CASCADES) - 1; i > 0; --i) {
+            vec2 pos = (uv - scene.cascadeCenter) * exp2f(i) + 0.5f;
+            if (pos.x >= 0.0f && pos.y >= 0.0f && pos.x < 1.0f && pos.y < 1.0f) return vec3(pos, (float)i);
+        }
+        return vec3(uv, 0.0f);
+    }
+    
+    // without an atlas (fields made on the GPU), leaps of the pyramid are all there is
+    static float field_distance(const Scene& scene, const vec3& pos, const float remaining) {
+        if (pos.x < 0.0f || pos.y < 0.0f || pos.x >= 1.0f || pos.y >= 1.0f) return 0.0f;
+        vec2 pixel = vec2(pos) * scene.fieldSize;
+        vec2 tile = floor(pixel / scene.fieldTileSize);
+        int layer = (int)pos.z;
+        float leap = 0.0f;
+        for (int level = (int)scene.pyramid.size() - 1; level >= 0; --level) {
+            leap = scene.pyramid[level].fetch((int)tile.x >> level, (int)tile.y >> level, layer).r;
+            if (leap >= remaining) return leap;
+        }
+        if (scene.distanceField.texels.empty()) return leap;
+        const int16_t* slot = &scene.tiles[(((size_t)layer * scene.numTile + (int)tile.y) * scene.numTile + (int)tile.x) * 2];
+        if (slot[0] < 0) return leap;
+        vec2 atlasPos = vec2(slot[0], slot[1]) * (scene.fieldTileSize + 2.0f) + 1.0f + (pixel - tile * scene.fieldTileSize);
+        vec2 atlasSize = vec2(scene.distanceField.width, scene.distanceField.height);
+        return std::max(leap, scene.distanceField.sample(atlasPos / atlasSize).r);
+    }
+    
+    static vec3 sample_aurora(const Scene& scene, const vec3& loc, const vec3& pos) {
+        float r = length(loc);
+        vec3 deposition = deposition_function(scene, r);
+        vec3 curtain = vec3(scene.paths.sample(vec2(pos), (int)pos.z).r);
+        return deposition * curtain;
+    }
+    
+    static vec3 sample_aurora(const Scene& scene, const ray& r, span s, int64_t& numSample) {
+        if (s.h < 0.0f) return vec3(0.0f);
+        if (s.l < 0.0f) s.l = 0.0f;
+        
+        vec3 sum = vec3(0.0f);
+        float t = s.l;
+        while (t < s.h) {
+            vec3 loc = ray_at(r, t);
+            vec3 pos = to_cascade(scene, down_to_map(loc));
+            sum += sample_aurora(scene, loc, pos);
+            ++numSample;
+            float dist = field_distance(scene, pos, (s.h - t) / km) * km;
+            if (dist < dt) dist = dt;
+            t += dist;
+        }
+        return sum * auroraScale;
+    }
+    
+    // GL_TEXTURE_CUBE_MAP without seamless filtering: faces are chosen by the
+    // major axis, and then sampled on their own
+    static vec3 sample_cube(const Texture faces[6], const vec3& dir) {
+        vec3 mag = abs(dir);
+        int face;
+        float sc, tc, ma;
+        if (mag.x >= mag.y && mag.x >= mag.z) {
+            face = dir.x > 0.0f ? 0 : 1;
+            sc = dir.x > 0.0f ? -dir.z : dir.z;
+            tc = -dir.y;
+            ma = mag.x;
+        } else if (mag.y >= mag.z) {
+            face = dir.y > 0.0f ? 2 : 3;
+            sc = dir.x;
+            tc = dir.y > 0.0f ? dir.z : -dir.z;
+            ma = mag.y;
+        } else {
+            face = dir.z > 0.0f ? 4 : 5;
+            sc = dir.z > 0.0f ? dir.x : -dir.x;
+            tc = -dir.y;
+            ma = mag.z;
+        }
+        return vec3(faces[face].sample(vec2(sc / ma + 1.0f, tc / ma + 1.0f) * 0.5f));
+    }
+    
+    // main of aurora.fs is split where the ray is marched, so that rays can also be marched in packets
+    struct Shading {
+        ray r;
+        span s; // to march along
+        float airTransmit;
+        bool isGround;
+    };
+    
+    static Shading begin_shading(const Scene& scene, const View& view, const vec2& ndc) {
+        vec3 fragPos = view.origin + ndc.x * view.xAxis + ndc.y * view.yAxis;
+        vec3 cameraDir = normalize(fragPos - view.cameraPos);
+        vec3 normal = normalize(view.cameraPos);
+        bool isGround = false;
+        if (dot(cameraDir, normal) <= 0.0f) {
+            // the same as flipping y in (originX, originY, originZ) of aurora.fs
+            isGround = true;
+            cameraDir -= 2.0f * dot(cameraDir, normal) * normal;
+        }
+        
+        ray r { view.cameraPos, cameraDir };
+        span auroraL = span_sphere({ vec3(0.0f), scene.auroraLowHeight * km + 1.0f }, r);
+        span auroraH = span_sphere({ vec3(0.0f), scene.auroraHighHeight * km + 1.0f }, r);
+        return { r, { auroraL.h, auroraH.h }, air_transmit(scene, dot(cameraDir, normal)), isGround };
+    }
+    
+    static vec4 end_shading(const Scene& scene, const Shading& shading, const vec3& aurora) {
+        float airInscatter = 1.0f - shading.airTransmit;
+        vec3 total = shading.airTransmit * aurora + airInscatter * airColor;
+        
+        vec3 foreground = tone_map(total);
+        vec3 background = sample_cube(scene.skybox, shading.r.D);
+        float bgStrength = 1.0f - length(foreground);
+        vec4 fragColor = vec4(foreground + bgStrength * background, 1.0f);
+        if (shading.isGround) fragColor *= 0.5f;
+        return fragColor;
+    }
+    
+    /*
+     rays of a packet as structure of arrays, which all start from the camera.
+     spans are clipped to the front of the camera, so lanes that have nothing
+     to march (or no ray) have low >= high. sum is that of sample_aurora, not
+     scaled yet
+     */
+    static const int MAX_LANES = 16;
+    struct Packet {
+        float dirX[MAX_LANES], dirY[MAX_LANES], dirZ[MAX_LANES], low[MAX_LANES], high[MAX_LANES];
+        float sum[3][MAX_LANES];
+    };
+    
+    /*
+     packet kernels: each lane is a ray, and takes the same steps as
+     sample_aurora does (with operations in the same order, so colors are the
+     same as the scalar version), while lanes that have left their spans are
+     masked out. texels are gathered, and lanes that are masked out gather the
+     first texel. deposition is sampled from a column that is already filtered
+     along x (see depositionColumn()). SSE4.1 has no gathers, so it marches
+     rays one by one instead
+     */
+    using MarchKernel = int64_t (*)(const Scene& scene, const float* column, const vec3& S, Packet& packet);
+    
+#ifdef RAYMARCH_X86
+    __attribute__((target("avx2")))
+    static inline __m256 gatherAVX2(const Texture& texture, const __m256i row, const __m256i x, const __m256i valid) {
+        __m256i index = _mm256_mullo_epi32(_mm256_add_epi32(row, x), _mm256_set1_epi32(texture.numChannel));
+        return _mm256_i32gather_ps(texture.texels.data(), _mm256_and_si256(index, valid), 4);
+    }
+    
+    // bilinear sampling of the first channel of a clamped texture, like Texture::sample()
+    __attribute__((target("avx2")))
+    static inline __m256 sampleAVX2(const Texture& texture, const __m256 u, const __m256 v, const __m256i layer,
+                                    const __m256i valid) {
+        const __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+        const __m256i zero = _mm256_setzero_si256(), unit = _mm256_set1_epi32(1);
+        const __m256i maxX = _mm256_set1_epi32(texture.width - 1), maxY = _mm256_set1_epi32(texture.height - 1);
+        __m256 posX = _mm256_sub_ps(_mm256_mul_ps(u, _mm256_set1_ps((float)texture.width)), half);
+        __m256 posY = _mm256_sub_ps(_mm256_mul_ps(v, _mm256_set1_ps((float)texture.height)), half);
+        __m256 baseX = _mm256_floor_ps(posX), baseY = _mm256_floor_ps(posY);
+        __m256 weightX = _mm256_sub_ps(posX, baseX), weightY = _mm256_sub_ps(posY, baseY);
+        __m256i x0 = _mm256_cvttps_epi32(baseX), y0 = _mm256_cvttps_epi32(baseY);
+        __m256i x1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(x0, unit), zero), maxX);
+        __m256i y1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(y0, unit), zero), maxY);
+        x0 = _mm256_min_epi32(_mm256_max_epi32(x0, zero), maxX);
+        y0 = _mm256_min_epi32(_mm256_max_epi32(y0, zero), maxY);
+        
+        __m256i layerRow = _mm256_mullo_epi32(layer, _mm256_set1_epi32(texture.height));
+        __m256i row0 = _mm256_mullo_epi32(_mm256_add_epi32(layerRow, y0), _mm256_set1_epi32(texture.width));
+        __m256i row1 = _mm256_mullo_epi32(_mm256_add_epi32(layerRow, y1), _mm256_set1_epi32(texture.width));
+        __m256 oneMinusX = _mm256_sub_ps(one, weightX);
+        __m256 top = _mm256_add_ps(_mm256_mul_ps(gatherAVX2(texture, row0, x0, valid), oneMinusX),
+                                   _mm256_mul_ps(gatherAVX2(texture, row0, x1, valid), weightX));
+        __m256 bottom = _mm256_add_ps(_mm256_mul_ps(gatherAVX2(texture, row1, x0, valid), oneMinusX),
+                                      _mm256_mul_ps(gatherAVX2(texture, row1, x1, valid), weightX));
+        return _mm256_add_ps(_mm256_mul_ps(top, _mm256_sub_ps(one, weightY)), _mm256_mul_ps(bottom, weightY));
+    }
+    
+    // field_distance, where lanes out of valid get 0
+    __attribute__((target("avx2")))
+    static inline __m256 fieldDistanceAVX2(const Scene& scene, const __m256 posX, const __m256 posY,
+                                           const __m256i layer, const __m256 remaining, const __m256 valid) {
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+        const __m256 tileSize = _mm256_set1_ps(scene.fieldTileSize);
+        __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(posX, zero, _CMP_GE_OQ), _mm256_cmp_ps(posY, zero, _CMP_GE_OQ)),
+                                      _mm256_and_ps(_mm256_cmp_ps(posX, one, _CMP_LT_OQ), _mm256_cmp_ps(posY, one, _CMP_LT_OQ)));
+        __m256i pending = _mm256_castps_si256(_mm256_and_ps(inside, valid));
+        __m256 pixelX = _mm256_mul_ps(posX, _mm256_set1_ps(scene.fieldSize));
+        __m256 pixelY = _mm256_mul_ps(posY, _mm256_set1_ps(scene.fieldSize));
+        __m256 tileX = _mm256_floor_ps(_mm256_div_ps(pixelX, tileSize));
+        __m256 tileY = _mm256_floor_ps(_mm256_div_ps(pixelY, tileSize));
+        __m256i tx = _mm256_cvttps_epi32(tileX), ty = _mm256_cvttps_epi32(tileY);
+        
+        __m256 leap = zero;
+        for (int level = (int)scene.pyramid.size() - 1; level >= 0; --level) {
+            const Texture& pyramid = scene.pyramid[level];
+            __m128i shift = _mm_cvtsi32_si128(level);
+            __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(layer, _mm256_set1_epi32(pyramid.height)),
+                                             _mm256_sra_epi32(ty, shift));
+            index = _mm256_add_epi32(_mm256_mullo_epi32(index, _mm256_set1_epi32(pyramid.width)), _mm256_sra_epi32(tx, shift));
+            __m256 value = _mm256_i32gather_ps(pyramid.texels.data(), _mm256_and_si256(index, pending), 4);
+            leap = _mm256_blendv_ps(leap, value, _mm256_castsi256_ps(pending));
+            pending = _mm256_andnot_si256(_mm256_castps_si256(_mm256_cmp_ps(value, remaining, _CMP_GE_OQ)), pending);
+        }
+        if (scene.distanceField.texels.empty() || _mm256_testz_si256(pending, pending)) return leap;
+        
+        // slots are pairs of int16, gathered as int32
+        const __m256i numTile = _mm256_set1_epi32(scene.numTile);
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(layer, numTile), ty), numTile), tx);
+        __m256i slot = _mm256_i32gather_epi32((const int *)scene.tiles.data(), _mm256_and_si256(index, pending), 4);
+        __m256i slotX = _mm256_srai_epi32(_mm256_slli_epi32(slot, 16), 16), slotY = _mm256_srai_epi32(slot, 16);
+        __m256i hasSlot = _mm256_and_si256(pending, _mm256_cmpgt_epi32(slotX, _mm256_set1_epi32(-1)));
+        const __m256 border = _mm256_set1_ps(scene.fieldTileSize + 2.0f);
+        __m256 atlasX = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(slotX), border), one),
+                                      _mm256_sub_ps(pixelX, _mm256_mul_ps(tileX, tileSize)));
+        __m256 atlasY = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(slotY), border), one),
+                                      _mm256_sub_ps(pixelY, _mm256_mul_ps(tileY, tileSize)));
+        __m256 value = sampleAVX2(scene.distanceField,
+                                  _mm256_div_ps(atlasX, _mm256_set1_ps((float)scene.distanceField.width)),
+                                  _mm256_div_ps(atlasY, _mm256_set1_ps((float)scene.distanceField.height)),
+                                  _mm256_setzero_si256(), hasSlot);
+        return _mm256_blendv_ps(leap, _mm256_max_ps(value, leap), _mm256_castsi256_ps(hasSlot));
+    }
+    
+    // rows of the deposition column, which repeats. spans only reach the
+    // periods next to the first one, which are kept in bounds anyway
+    __attribute__((target("avx2")))
+    static inline __m256i wrapRowsAVX2(__m256i y, const int height, const __m256i valid) {
+        const __m256i size = _mm256_set1_epi32(height), none = _mm256_setzero_si256();
+        y = _mm256_add_epi32(y, _mm256_and_si256(_mm256_cmpgt_epi32(none, y), size));
+        y = _mm256_sub_epi32(y, _mm256_andnot_si256(_mm256_cmpgt_epi32(size, y), size));
+        y = _mm256_min_epi32(_mm256_max_epi32(y, none), _mm256_set1_epi32(height - 1));
+        return _mm256_and_si256(_mm256_mullo_epi32(y, _mm256_set1_epi32(3)), valid);
+    }
+    
+    __attribute__((target("avx2")))
+    static int64_t marchAVX2(const Scene& scene, const float* column, const vec3& S, Packet& packet) {
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+        const int numCascade = std::min(scene.paths.numLayer, MAX_CASCADES);
+        const int depositionHeight = scene.deposition.height;
+        __m256 dirX = _mm256_loadu_ps(packet.dirX), dirY = _mm256_loadu_ps(packet.dirY), dirZ = _mm256_loadu_ps(packet.dirZ);
+        __m256 t = _mm256_loadu_ps(packet.low), high = _mm256_loadu_ps(packet.high);
+        __m256 sum[3] = { zero, zero, zero };
+        __m256 active = _mm256_cmp_ps(t, high, _CMP_LT_OQ);
+        int64_t numSample = 0;
+        while (int lanes = _mm256_movemask_ps(active)) {
+            numSample += __builtin_popcount(lanes);
+            __m256i valid = _mm256_castps_si256(active);
+            __m256 locX = _mm256_add_ps(_mm256_set1_ps(S.x), _mm256_mul_ps(dirX, t));
+            __m256 locY = _mm256_add_ps(_mm256_set1_ps(S.y), _mm256_mul_ps(dirY, t));
+            __m256 locZ = _mm256_add_ps(_mm256_set1_ps(S.z), _mm256_mul_ps(dirZ, t));
+            
+            // down_to_map and to_cascade, where the last cascade that holds the point wins
+            __m256 scale = _mm256_div_ps(_mm256_set1_ps(2.0f), _mm256_add_ps(locY, one));
+            __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(locX, scale), _mm256_set1_ps(2.0f)), _mm256_set1_ps(0.25f));
+            __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(locZ, scale), _mm256_set1_ps(2.0f)), _mm256_set1_ps(0.25f));
+            __m256 posX = u, posY = v;
+            __m256i layer = _mm256_setzero_si256();
+            for (int i = 1; i < numCascade; ++i) {
+                __m256 factor = _mm256_set1_ps(exp2f(i));
+                __m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(u, _mm256_set1_ps(scene.cascadeCenter.x)), factor), half);
+                __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(v, _mm256_set1_ps(scene.cascadeCenter.y)), factor), half);
+                __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ), _mm256_cmp_ps(y, zero, _CMP_GE_OQ)),
+                                              _mm256_and_ps(_mm256_cmp_ps(x, one, _CMP_LT_OQ), _mm256_cmp_ps(y, one, _CMP_LT_OQ)));
+                posX = _mm256_blendv_ps(posX, x, inside);
+                posY = _mm256_blendv_ps(posY, y, inside);
+                layer = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(layer),
+                                                             _mm256_castsi256_ps(_mm256_set1_epi32(i)), inside));
+            }
+            
+            // sample_aurora, where deposition repeats along y
+            __m256 r = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(locX, locX), _mm256_mul_ps(locY, locY)),
+                                                    _mm256_mul_ps(locZ, locZ)));
+            __m256 height = _mm256_div_ps(_mm256_sub_ps(r, one), _mm256_set1_ps(300.0f * km));
+            __m256 depY = _mm256_sub_ps(_mm256_mul_ps(height, _mm256_set1_ps((float)depositionHeight)), half);
+            __m256 depBase = _mm256_floor_ps(depY), depWeight = _mm256_sub_ps(depY, depBase);
+            __m256i y0 = wrapRowsAVX2(_mm256_cvttps_epi32(depBase), depositionHeight, valid);
+            __m256i y1 = wrapRowsAVX2(_mm256_add_epi32(_mm256_cvttps_epi32(depBase), _mm256_set1_epi32(1)),
+                                      depositionHeight, valid);
+            __m256 curtain = sampleAVX2(scene.paths, posX, posY, layer, valid);
+            for (int c = 0; c < 3; ++c) {
+                __m256 top = _mm256_i32gather_ps(column + c, y0, 4), bottom = _mm256_i32gather_ps(column + c, y1, 4);
+                __m256 deposition = _mm256_add_ps(_mm256_mul_ps(top, _mm256_sub_ps(one, depWeight)), _mm256_mul_ps(bottom, depWeight));
+                sum[c] = _mm256_add_ps(sum[c], _mm256_and_ps(_mm256_mul_ps(deposition, curtain), active));
+            }
+            
+            __m256 remaining = _mm256_div_ps(_mm256_sub_ps(high, t), _mm256_set1_ps(km));
+            __m256 dist = _mm256_mul_ps(fieldDistanceAVX2(scene, posX, posY, layer, remaining, active), _mm256_set1_ps(km));
+            dist = _mm256_blendv_ps(dist, _mm256_set1_ps(dt), _mm256_cmp_ps(dist, _mm256_set1_ps(dt), _CMP_LT_OQ));
+            t = _mm256_blendv_ps(t, _mm256_add_ps(t, dist), active);
+            active = _mm256_and_ps(active, _mm256_cmp_ps(t, high, _CMP_LT_OQ));
+        }
+        for (int c = 0; c < 3; ++c) _mm256_storeu_ps(packet.sum[c], sum[c]);
+        return numSample;
+    }
+    
+    // the same as the AVX2 kernel, with masks in registers of their own
+    __attribute__((target("avx512f")))
+    static inline __m512 gatherAVX512(const Texture& texture, const __m512i row, const __m512i x, const __mmask16 valid) {
+        __m512i index = _mm512_mullo_epi32(_mm512_add_epi32(row, x), _mm512_set1_epi32(texture.numChannel));
+        return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), valid, index, texture.texels.data(), 4);
+    }
+    
+    __attribute__((target("avx512f")))
+    static inline __m512 sampleAVX512(const Texture& texture, const __m512 u, const __m512 v, const __m512i layer,
+                                      const __mmask16 valid) {
+        const __m512 one = _mm512_set1_ps(1.0f), half = _mm512_set1_ps(0.5f);
+        const __m512i zero = _mm512_setzero_si512(), unit = _mm512_set1_epi32(1);
+        const __m512i maxX = _mm512_set1_epi32(texture.width - 1), maxY = _mm512_set1_epi32(texture.height - 1);
+        __m512 posX = _mm512_sub_ps(_mm512_mul_ps(u, _mm512_set1_ps((float)texture.width)), half);
+        __m512 posY = _mm512_sub_ps(_mm512_mul_ps(v, _mm512_set1_ps((float)texture.height)), half);
+        __m512 baseX = _mm512_floor_ps(posX), baseY = _mm512_floor_ps(posY);
+        __m512 weightX = _mm512_sub_ps(posX, baseX), weightY = _mm512_sub_ps(posY, baseY);
+        __m512i x0 = _mm512_cvttps_epi32(baseX), y0 = _mm512_cvttps_epi32(baseY);
+        __m512i x1 = _mm512_min_epi32(_mm512_max_epi32(_mm512_add_epi32(x0, unit), zero), maxX);
+        __m512i y1 = _mm512_min_epi32(_mm512_max_epi32(_mm512_add_epi32(y0, unit), zero), maxY);
+        x0 = _mm512_min_epi32(_mm512_max_epi32(x0, zero), maxX);
+        y0 = _mm512_min_epi32(_mm512_max_epi32(y0, zero), maxY);
+        
+        __m512i layerRow = _mm512_mullo_epi32(layer, _mm512_set1_epi32(texture.height));
+        __m512i row0 = _mm512_mullo_epi32(_mm512_add_epi32(layerRow, y0), _mm512_set1_epi32(texture.width));
+        __m512i row1 = _mm512_mullo_epi32(_mm512_add_epi32(layerRow, y1), _mm512_set1_epi32(texture.width));
+        __m512 oneMinusX = _mm512_sub_ps(one, weightX);
+        __m512 top = _mm512_add_ps(_mm512_mul_ps(gatherAVX512(texture, row0, x0, valid), oneMinusX),
+                                   _mm512_mul_ps(gatherAVX512(texture, row0, x1, valid), weightX));
+        __m512 bottom = _mm512_add_ps(_mm512_mul_ps(gatherAVX512(texture, row1, x0, valid), oneMinusX),
+                                      _mm512_mul_ps(gatherAVX512(texture, row1, x1, valid), weightX));
+        return _mm512_add_ps(_mm512_mul_ps(top, _mm512_sub_ps(one, weightY)), _mm512_mul_ps(bottom, weightY));
+    }
+    
+    __attribute__((target("avx512f")))
+    static inline __m512 fieldDistanceAVX512(const Scene& scene, const __m512 posX, const __m512 posY,
+                                             const __m512i layer, const __m512 remaining, const __mmask16 valid) {
+        const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+        const __m512 tileSize = _mm512_set1_ps(scene.fieldTileSize);
+        __mmask16 pending = valid & _mm512_cmp_ps_mask(posX, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(posY, zero, _CMP_GE_OQ)
+            & _mm512_cmp_ps_mask(posX, one, _CMP_LT_OQ) & _mm512_cmp_ps_mask(posY, one, _CMP_LT_OQ);
+        __m512 pixelX = _mm512_mul_ps(posX, _mm512_set1_ps(scene.fieldSize));
+        __m512 pixelY = _mm512_mul_ps(posY, _mm512_set1_ps(scene.fieldSize));
+        __m512 tileX = _mm512_floor_ps(_mm512_div_ps(pixelX, tileSize));
+        __m512 tileY = _mm512_floor_ps(_mm512_div_ps(pixelY, tileSize));
+        __m512i tx = _mm512_cvttps_epi32(tileX), ty = _mm512_cvttps_epi32(tileY);
+        
+        __m512 leap = zero;
+        for (int level = (int)scene.pyramid.size() - 1; level >= 0; --level) {
+            const Texture& pyramid = scene.pyramid[level];
+            __m128i shift = _mm_cvtsi32_si128(level);
+            __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(layer, _mm512_set1_epi32(pyramid.height)),
+                                             _mm512_sra_epi32(ty, shift));
+            index = _mm512_add_epi32(_mm512_mullo_epi32(index, _mm512_set1_epi32(pyramid.width)), _mm512_sra_epi32(tx, shift));
+            __m512 value = _mm512_mask_i32gather_ps(zero, pending, index, pyramid.texels.data(), 4);
+            leap = _mm512_mask_blend_ps(pending, leap, value);
+            pending &= ~_mm512_cmp_ps_mask(value, remaining, _CMP_GE_OQ);
+        }
+        if (scene.distanceField.texels.empty() || !pending) return leap;
+        
+        const __m512i numTile = _mm512_set1_epi32(scene.numTile);
+        __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_add_epi32(_mm512_mullo_epi32(layer, numTile), ty), numTile), tx);
+        __m512i slot = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), pending, index, scene.tiles.data(), 4);
+        __m512i slotX = _mm512_srai_epi32(_mm512_slli_epi32(slot, 16), 16), slotY = _mm512_srai_epi32(slot, 16);
+        __mmask16 hasSlot = pending & _mm512_cmpgt_epi32_mask(slotX, _mm512_set1_epi32(-1));
+        const __m512 border = _mm512_set1_ps(scene.fieldTileSize + 2.0f);
+        __m512 atlasX = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(slotX), border), one),
+                                      _mm512_sub_ps(pixelX, _mm512_mul_ps(tileX, tileSize)));
+        __m512 atlasY = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(slotY), border), one),
+                                      _mm512_sub_ps(pixelY, _mm512_mul_ps(tileY, tileSize)));
+        __m512 value = sampleAVX512(scene.distanceField,
+                                    _mm512_div_ps(atlasX, _mm512_set1_ps((float)scene.distanceField.width)),
+                                    _mm512_div_ps(atlasY, _mm512_set1_ps((float)scene.distanceField.height)),
+                                    _mm512_setzero_si512(), hasSlot);
+        return _mm512_mask_blend_ps(hasSlot, leap, _mm512_max_ps(value, leap));
+    }
+    
+    __attribute__((target("avx512f")))
+    static inline __m512i wrapRowsAVX512(__m512i y, const int height) {
+        const __m512i size = _mm512_set1_epi32(height), none = _mm512_setzero_si512();
+        y = _mm512_mask_add_epi32(y, _mm512_cmplt_epi32_mask(y, none), y, size);
+        y = _mm512_mask_sub_epi32(y, _mm512_cmpge_epi32_mask(y, size), y, size);
+        y = _mm512_min_epi32(_mm512_max_epi32(y, none), _mm512_set1_epi32(height - 1));
+        return _mm512_mullo_epi32(y, _mm512_set1_epi32(3));
+    }
+    
+    __attribute__((target("avx512f")))
+    static int64_t marchAVX512(const Scene& scene, const float* column, const vec3& S, Packet& packet) {
+        const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f), half = _mm512_set1_ps(0.5f);
+        const int numCascade = std::min(scene.paths.numLayer, MAX_CASCADES);
+        const int depositionHeight = scene.deposition.height;
+        __m512 dirX = _mm512_loadu_ps(packet.dirX), dirY = _mm512_loadu_ps(packet.dirY), dirZ = _mm512_loadu_ps(packet.dirZ);
+        __m512 t = _mm512_loadu_ps(packet.low), high = _mm512_loadu_ps(packet.high);
+        __m512 sum[3] = { zero, zero, zero };
+        __mmask16 active = _mm512_cmp_ps_mask(t, high, _CMP_LT_OQ);
+        int64_t numSample = 0;
+        while (active) {
+            numSample += __builtin_popcount(active);
+            __m512 locX = _mm512_add_ps(_mm512_set1_ps(S.x), _mm512_mul_ps(dirX, t));
+            __m512 locY = _mm512_add_ps(_mm512_set1_ps(S.y), _mm512_mul_ps(dirY, t));
+            __m512 locZ = _mm512_add_ps(_mm512_set1_ps(S.z), _mm512_mul_ps(dirZ, t));
+            
+            __m512 scale = _mm512_div_ps(_mm512_set1_ps(2.0f), _mm512_add_ps(locY, one));
+            __m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(locX, scale), _mm512_set1_ps(2.0f)), _mm512_set1_ps(0.25f));
+            __m512 v = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(locZ, scale), _mm512_set1_ps(2.0f)), _mm512_set1_ps(0.25f));
+            __m512 posX = u, posY = v;
+            __m512i layer = _mm512_setzero_si512();
+            for (int i = 1; i < numCascade; ++i) {
+                __m512 factor = _mm512_set1_ps(exp2f(i));
+                __m512 x = _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(u, _mm512_set1_ps(scene.cascadeCenter.x)), factor), half);
+                __m512 y = _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(v, _mm512_set1_ps(scene.cascadeCenter.y)), factor), half);
+                __mmask16 inside = _mm512_cmp_ps_mask(x, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(y, zero, _CMP_GE_OQ)
+                    & _mm512_cmp_ps_mask(x, one, _CMP_LT_OQ) & _mm512_cmp_ps_mask(y, one, _CMP_LT_OQ);
+                posX = _mm512_mask_blend_ps(inside, posX, x);
+                posY = _mm512_mask_blend_ps(inside, posY, y);
+                layer = _mm512_mask_blend_epi32(inside, layer, _mm512_set1_epi32(i));
+            }
+            
+            __m512 r = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(locX, locX), _mm512_mul_ps(locY, locY)),
+                                                    _mm512_mul_ps(locZ, locZ)));
+            __m512 height = _mm512_div_ps(_mm512_sub_ps(r, one), _mm512_set1_ps(300.0f * km));
+            __m512 depY = _mm512_sub_ps(_mm512_mul_ps(height, _mm512_set1_ps((float)depositionHeight)), half);
+            __m512 depBase = _mm512_floor_ps(depY), depWeight = _mm512_sub_ps(depY, depBase);
+            __m512i y0 = wrapRowsAVX512(_mm512_cvttps_epi32(depBase), depositionHeight);
+            __m512i y1 = wrapRowsAVX512(_mm512_add_epi32(_mm512_cvttps_epi32(depBase), _mm512_set1_epi32(1)),
+                                        depositionHeight);
+            __m512 curtain = sampleAVX512(scene.paths, posX, posY, layer, active);
+            for (int c = 0; c < 3; ++c) {
+                __m512 top = _mm512_mask_i32gather_ps(zero, active, y0, column + c, 4);
+                __m512 bottom = _mm512_mask_i32gather_ps(zero, active, y1, column + c, 4);
+                __m512 deposition = _mm512_add_ps(_mm512_mul_ps(top, _mm512_sub_ps(one, depWeight)), _mm512_mul_ps(bottom, depWeight));
+                sum[c] = _mm512_mask_add_ps(sum[c], active, sum[c], _mm512_mul_ps(deposition, curtain));
+            }
+            
+            __m512 remaining = _mm512_div_ps(_mm512_sub_ps(high, t), _mm512_set1_ps(km));
+            __m512 dist = _mm512_mul_ps(fieldDistanceAVX512(scene, posX, posY, layer, remaining, active), _mm512_set1_ps(km));
+            dist = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(dist, _mm512_set1_ps(dt), _CMP_LT_OQ), dist, _mm512_set1_ps(dt));
+            t = _mm512_mask_add_ps(t, active, t, dist);
+            active &= _mm512_cmp_ps_mask(t, high, _CMP_LT_OQ);
+        }
+        for (int c = 0; c < 3; ++c) _mm512_storeu_ps(packet.sum[c], sum[c]);
+        return numSample;
+    }
+#endif
+    
+    static MarchKernel selectKernel(const DistanceField::Isa isa) {
+        if (isa > DistanceField::bestIsa()) throw std::runtime_error("Instruction set not supported by CPU");
+        switch (isa) {
+#ifdef RAYMARCH_X86
+            case DistanceField::Isa::AVX2: return marchAVX2;
+            case DistanceField::Isa::AVX512: return marchAVX512;
+#endif
+            default: return nullptr;
+        }
+    }
+    
+    // deposition_function always samples at the same x, so texels are filtered along x once for all
+    static std::vector<float> depositionColumn(const Texture& deposition) {
+        float x = 0.8f * deposition.width - 0.5f, base = floor(x), weight = x - base;
+        auto wrap = [&] (const int index) { return (index % deposition.width + deposition.width) % deposition.width; };
+        int x0 = wrap((int)base), x1 = wrap((int)base + 1);
+        std::vector<float> column(deposition.height * 3);
+        for (int y = 0; y < deposition.height; ++y) {
+            vec4 texel = mix(deposition.fetch(x0, y), deposition.fetch(x1, y), weight);
+            for (int c = 0; c < 3; ++c) column[y * 3 + c] = texel[c];
+        }
+        return column;
+    }
+    
+    Renderer::Renderer(const int numThread, const int tileSize, const DistanceField::Isa isa):
+    numThread(std::max(numThread, 1)),
+    tileSize(tileSize),
+    isa(isa) {
+        selectKernel(isa);
+    }
+    
+    Stats Renderer::operator()(const Scene& scene, const View& view, const int width, const int height,
+                               unsigned char* image) const {
+        auto start = std::chrono::steady_clock::now();
+        int numTileX = (width + tileSize - 1) / tileSize, numTileY = (height + tileSize - 1) / tileSize;
+        MarchKernel kernel = selectKernel(isa);
+        int numLane = isa == DistanceField::Isa::AVX512 ? 16 : kernel ? 8 : 1;
+        std::vector<float> column = kernel ? depositionColumn(scene.deposition) : std::vector<float>();
+        std::atomic<int> nextTile(0);
+        std::atomic<int64_t> numSample(0);
+        auto renderTiles = [&] {
+            int64_t localSample = 0;
+            Shading shadings[MAX_LANES];
+            Packet packet;
+            for (int tile = nextTile++; tile < numTileX * numTileY; tile = nextTile++) {
+                int x0 = tile % numTileX * tileSize, y0 = tile / numTileX * tileSize;
+                int xEnd = std::min(x0 + tileSize, width);
+                for (int y = y0; y < std::min(y0 + tileSize, height); ++y) {
+                    // neighbouring pixels of a row make a packet
+                    for (int x = x0; x < xEnd; x += numLane) {
+                        int count = std::min(numLane, xEnd - x);
+                        for (int i = 0; i < count; ++i) {
+                            // at the center of pixels, as fragments are
+                            vec2 ndc = (vec2(x + i, y) + 0.5f) / vec2(width, height) * 2.0f - 1.0f;
+                            shadings[i] = begin_shading(scene, view, ndc);
+                        }
+                        vec3 aurora[MAX_LANES];
+                        if (kernel) {
+                            for (int i = 0; i < numLane; ++i) {
+                                const Shading& shading = shadings[std::min(i, count - 1)];
+                                packet.dirX[i] = shading.r.D.x;
+                                packet.dirY[i] = shading.r.D.y;
+                                packet.dirZ[i] = shading.r.D.z;
+                                packet.low[i] = std::max(shading.s.l, 0.0f);
+                                packet.high[i] = i < count ? shading.s.h : 0.0f;
+                            }
+                            localSample += kernel(scene, column.data(), view.cameraPos, packet);
+                            for (int i = 0; i < count; ++i)
+                                aurora[i] = vec3(packet.sum[0][i], packet.sum[1][i], packet.sum[2][i]) * auroraScale;
+                        } else {
+                            aurora[0] = sample_aurora(scene, shadings[0].r, shadings[0].s, localSample);
+                        }
+                        for (int i = 0; i < count; ++i) {
+                            vec4 color = end_shading(scene, shadings[i], aurora[i]);
+                            for (int c = 0; c < 3; ++c) {
+                                float value = color[c] >= 0.0f ? std::min(color[c], 1.0f) : 0.0f; // NaN as 0
+                                image[((size_t)y * width + x + i) * 3 + c] = (unsigned char)round(value * 255.0f);
+                            }
+                        }
+                    }
+                }
+            }
+            numSample += localSample;
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < numThread; ++i) threads.emplace_back(renderTiles);
+        renderTiles();
+        for (std::thread& thread : threads) thread.join();
+        
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return { milliseconds, (int64_t)width * height, numSample };
+    }
+}
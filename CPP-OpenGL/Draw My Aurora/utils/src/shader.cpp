@@ -104,6 +104,18 @@ Shader::Shader(const string& vertexPath,
     if (geometry != GL_INVALID_INDEX) glDeleteShader(geometry);
 }
 
+Shader::Shader(const string& computePath) {
+    GLuint compute = createShader(GL_COMPUTE_SHADER, readCode(computePath).c_str());
+    validateShader(compute);
+    
+    programId = glCreateProgram();
+    glAttachShader(programId, compute);
+    glLinkProgram(programId);
+    validateLink(programId);
+    
+    glDeleteShader(compute);
+}
+
 void Shader::use() const {
     glUseProgram(programId);
 }